@@ -2,7 +2,18 @@
 //  data_convert.cpp
 //
 #include "data_convert.h"
+#include "data_type.h"
 #include "logging.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <algorithm>
 
 typedef unsigned char byte;
 
@@ -15,141 +26,480 @@ static const string TRN_VTR_PATH = "/trn_vtr";
 static const string TRN_LBL_PATH = "/trn_lbl";
 static const string TST_VTR_PATH = "/tst_vtr";
 static const string TST_LBL_PATH = "/tst_lbl";
+static const string TRUE_NN_PATH = "/k_true_nn";
 
-void data_generate(const string& data_name, size_t TRAIN_MAX, size_t TEST_MAX, size_t WIDTH) {
-	float ** databuf = new float*[TRAIN_MAX];
-	for (int i = 0; i < TRAIN_MAX; ++i) {
-		databuf[i] = new float[WIDTH];
-	}
-	unsigned int * labelbuf = new unsigned int[TRAIN_MAX];
-    
-	char * strbuf = new char[TRAIN_MAX];
-	char * tok;
-    byte res;
-    int datah, dataw;
-    size_t labelh;
-    
-    
-    FILE * fin, * fout1, * fout2;
-    
-    
-    /* WRITE TRAIN DATA AND LABEL*/
-    LOG_INFO("> converting data\n");
-    LOG_FINE("  > populating data buffer for train data\n");
+//bytes of csv text handed to the parser threads at a time
+static const size_t BATCH_BYTES = 64 << 20;
 
-    string filepath = data_name + TRAIN_VECTOR_PATH;
-    fin = fopen(filepath.c_str(), "rb");
-    if (fin == NULL)
-    {
-        LOG_ERROR("ERROR: Can't locate the input file.\n");
-        return;
-    }
-    
-	LOG_INFO("Reading train vectors\n");
-    //height is the number of vectors
-    datah = 0;
-    while (fgets(strbuf, TRAIN_MAX, fin)) {
-		if (datah % 10000) LOG_FINE("    > %ld\n", datah);
-        tok = strtok(strbuf, ",");
-        dataw = 0;
-        while (tok) {
-            databuf[datah][dataw] = atof(tok);
-            tok = strtok(NULL, ",");
-            dataw++;
+/*
+ * Parses the comma separated line [p, eol) into <out>. Missing fields are
+ * left 0 and extra fields are dropped. Returns the number of fields seen.
+ * The character at <eol> must not be part of a number.
+ */
+static size_t parse_line(const char * p, const char * eol, size_t width, float * out)
+{
+    size_t fields = 0;
+    while (p < eol) {
+        if (*p != ',') {
+            char * end;
+            float value = strtof(p, &end);
+            if (end > eol || end == p)
+                end = (char *)p;
+            else if (fields < width)
+                out[fields] = value;
+            p = end;
+            //skip anything left of the field, e.g. '\r'
+            while (p < eol && *p != ',')
+                p++;
         }
-        datah++;
+        fields++;
+        if (p < eol)
+            p++;
     }
-    fclose(fin);
-    LOG_INFO("  > dimensions w: %d, h: %d\n", dataw, datah);
-    filepath = data_name+TRAIN_LABEL_PATH;
-    fin = fopen(filepath.c_str(), "rb");
-    filepath = data_name+TRN_VTR_PATH;
-    fout1 = fopen(filepath.c_str(), "wb");
-    filepath = data_name+TRN_LBL_PATH;
-    fout2 = fopen(filepath.c_str(), "wb");
-    
-    labelh = 0;
-	LOG_INFO("Reading train labels\n");
-    while (fscanf(fin, "%d\n", &labelbuf[labelh]) != EOF) {
-		if (labelh % 10000) LOG_FINE("    > %ld:    %d\n", labelh, labelbuf[labelh]);
-        labelh++;
+    return fields;
+}
+
+/*
+ * Parses every line of [begin, end) into rows of <width> floats appended to
+ * <rows>. Counts the lines whose width differs from <width> in <bad>.
+ */
+static void parse_chunk(const char * begin, const char * end, const char * file_end,
+        size_t width, vector<float> * rows, size_t * bad)
+{
+    *bad = 0;
+    const char * p = begin;
+    while (p < end) {
+        const char * eol = (const char *)memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        if (eol > p && !(eol - p == 1 && *p == '\r')) {
+            rows->resize(rows->size() + width, 0);
+            float * out = &(*rows)[rows->size() - width];
+            size_t fields;
+            if (eol == file_end) {
+                //strtof needs a terminator after the last line of the map
+                string last (p, eol);
+                fields = parse_line(last.c_str(), last.c_str() + last.size(), width, out);
+            }
+            else
+                fields = parse_line(p, eol, width, out);
+            if (fields != width)
+                (*bad)++;
+        }
+        p = eol + 1;
     }
-    
+}
+
+/* Writes the typed header of a vector file. */
+static void write_vector_header(FILE * fout, size_t rows, size_t width, size_t type)
+{
+    size_t magic = DATA_SET_MAGIC;
+    fwrite((const char *)&magic, sizeof(size_t), 1, fout);
+    fwrite((const char *)&type, sizeof(size_t), 1, fout);
     //height and width at the beginning of the vector data
-    fwrite((const char *)&TRAIN_MAX, sizeof(size_t), 1, fout1);
-    fwrite((const char *)&WIDTH, sizeof(size_t), 1, fout1);
-    
+    fwrite((const char *)&rows, sizeof(size_t), 1, fout);
+    fwrite((const char *)&width, sizeof(size_t), 1, fout);
+}
+
+/*
+ * Writes <count> values as elements of <type>. Values are rounded and
+ * clamped into 0..255 for DATA_TYPE_UINT8. Returns the number of values
+ * that did not fit.
+ */
+static size_t write_elements(FILE * fout, const float * values, size_t count, size_t type)
+{
+    if (type == DATA_TYPE_FLOAT) {
+        fwrite((const char *)values, sizeof(float), count, fout);
+        return 0;
+    }
+    size_t clamped = 0;
+    vector<uint8_t> bytes (count);
+    for (size_t i = 0; i < count; i++) {
+        float value = rintf(values[i]);
+        if (!(value >= 0 && value <= 255 && value == values[i]))
+            clamped++;
+        bytes[i] = value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+    }
+    fwrite((const char *)&bytes[0], sizeof(uint8_t), count, fout);
+    return clamped;
+}
+
+/* Returns the first position after the line containing <p>. */
+static const char * next_line(const char * p, const char * end)
+{
+    if (p >= end)
+        return end;
+    const char * eol = (const char *)memchr(p, '\n', end - p);
+    return eol == NULL ? end : eol + 1;
+}
+
+/*
+ * Streams the csv file <in_path> into the binary vector file <out_path>.
+ * The file is mapped and parsed a batch at a time, each batch split at
+ * line boundaries over all hardware threads, and rows are written as soon
+ * as their batch is parsed. At most <max_rows> rows are written; the row
+ * count in the header is patched once the file is done. Rows are stored
+ * as elements of <type>.
+ * Returns the number of rows written.
+ */
+static size_t convert_vectors(const string & in_path, const string & out_path,
+        size_t max_rows, size_t width, size_t type)
+{
+    int fd = open(in_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("ERROR: Can't locate the input file %s.\n", in_path.c_str());
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        LOG_ERROR("ERROR: Can't stat the input file %s.\n", in_path.c_str());
+        close(fd);
+        return 0;
+    }
+    size_t length = info.st_size;
+    const char * data = NULL;
+    if (length > 0) {
+        void * map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            LOG_ERROR("ERROR: Can't map the input file %s.\n", in_path.c_str());
+            close(fd);
+            return 0;
+        }
+        madvise(map, length, MADV_SEQUENTIAL);
+        data = (const char *)map;
+    }
+    close(fd);
+
+    FILE * fout = fopen(out_path.c_str(), "wb");
+    if (fout == NULL) {
+        LOG_ERROR("ERROR: Can't open the output file %s.\n", out_path.c_str());
+        if (data) munmap((void *)data, length);
+        return 0;
+    }
+    size_t rows = 0;
+    write_vector_header(fout, rows, width, type);
+
+    size_t thread_count = max(1u, thread::hardware_concurrency());
+    vector<thread> threads (thread_count);
+    vector<vector<float> > parsed (thread_count);
+    vector<size_t> bad (thread_count);
+    size_t bad_rows = 0;
+    size_t clamped = 0;
+    const char * file_end = data + length;
+    const char * batch = data;
+    while (batch < file_end && rows < max_rows) {
+        const char * batch_end = next_line(min(batch + BATCH_BYTES, file_end) - 1, file_end);
+        size_t step = (batch_end - batch + thread_count - 1) / thread_count;
+        const char * begin = batch;
+        for (size_t i = 0; i < thread_count; i++) {
+            const char * end = begin >= batch_end ? batch_end :
+                next_line(min(begin + step, batch_end) - 1, batch_end);
+            parsed[i].clear();
+            threads[i] = thread(parse_chunk, begin, end, file_end, width, &parsed[i], &bad[i]);
+            begin = end;
+        }
+        for (size_t i = 0; i < thread_count; i++) {
+            threads[i].join();
+            size_t count = min(parsed[i].size() / width, max_rows - rows);
+            if (count > 0)
+                clamped += write_elements(fout, &parsed[i][0], count * width, type);
+            rows += count;
+            bad_rows += bad[i];
+        }
+        LOG_FINE("    > %ld\n", rows);
+        batch = batch_end;
+    }
+    if (bad_rows > 0)
+        LOG_WARNING("%ld rows of %s do not have %ld columns\n", bad_rows, in_path.c_str(), width);
+    if (rows < max_rows)
+        LOG_WARNING("%s has only %ld of %ld rows\n", in_path.c_str(), rows, max_rows);
+    if (clamped > 0)
+        LOG_WARNING("%ld values of %s are not bytes and were clamped\n", clamped, in_path.c_str());
+
+    fseek(fout, 2 * sizeof(size_t), SEEK_SET);
+    fwrite((const char *)&rows, sizeof(size_t), 1, fout);
+    fclose(fout);
+    if (data) munmap((void *)data, length);
+    LOG_INFO("  > dimensions w: %ld, h: %ld\n", width, rows);
+    return rows;
+}
+
+/*
+ * Streams the first <rows> labels of <in_path>, one per line, into the
+ * binary label file <out_path>. Missing labels are written as 0.
+ */
+static void convert_labels(const string & in_path, const string & out_path, size_t rows)
+{
+    FILE * fin = fopen(in_path.c_str(), "rb");
+    if (fin == NULL) {
+        LOG_ERROR("ERROR: Can't locate the input file %s.\n", in_path.c_str());
+        return;
+    }
+    FILE * fout = fopen(out_path.c_str(), "wb");
+    if (fout == NULL) {
+        LOG_ERROR("ERROR: Can't open the output file %s.\n", out_path.c_str());
+        fclose(fin);
+        return;
+    }
     //only height at the begining of the label data
-    fwrite((const char *)&TRAIN_MAX, sizeof(size_t), 1, fout2);
-    
-    for (int i = 0; i < TRAIN_MAX; i++) {
-        res = (byte)labelbuf[i];
-        fwrite((const char *)&res, sizeof(byte), 1, fout2); //write in label data
-        fwrite((const char *)databuf[i], sizeof(float), WIDTH, fout1);
+    fwrite((const char *)&rows, sizeof(size_t), 1, fout);
+    size_t labelh = 0;
+    unsigned int label;
+    byte res;
+    while (labelh < rows && fscanf(fin, "%u\n", &label) == 1) {
+        res = (byte)label;
+        fwrite((const char *)&res, sizeof(byte), 1, fout);
+        labelh++;
     }
+    if (labelh < rows)
+        LOG_WARNING("%s has only %ld of %ld labels\n", in_path.c_str(), labelh, rows);
+    res = 0;
+    for (; labelh < rows; labelh++)
+        fwrite((const char *)&res, sizeof(byte), 1, fout);
     fclose(fin);
-    fclose(fout1);
-    fclose(fout2);
-    
-    /* TEST DATA */
-    fprintf(stderr, "> converting data\n");
-    fprintf(stderr, "  > populating data buffer for test data\n");
-    filepath = data_name+TEST_VECTOR_PATH;
-    fin = fopen(filepath.c_str(), "rb");
-    if (fin == NULL)
-    {
-        fprintf(stderr, "ERROR: Can't locate the input file.\n");
-        return;
+    fclose(fout);
+}
+
+/*
+ * A mapped .fvecs/.bvecs/.ivecs file. <elem> is the component size implied
+ * by the extension and <data> points at the header of the first row.
+ */
+struct VecsMap
+{
+    const char * data;
+    size_t length;
+    size_t elem;
+    size_t rows;
+    size_t width;
+    bool is_float;
+};
+
+/*
+ * Maps a .fvecs/.bvecs/.ivecs file into <vecs> and checks that every row
+ * has the dimension of the first. Returns false on error.
+ */
+static bool map_vecs(const string & path, VecsMap * vecs)
+{
+    string ext = path.size() >= 6 ? path.substr(path.size() - 6) : "";
+    if (ext == ".fvecs" || ext == ".ivecs")
+        vecs->elem = 4;
+    else if (ext == ".bvecs")
+        vecs->elem = 1;
+    else {
+        LOG_ERROR("ERROR: %s is not a .fvecs, .bvecs or .ivecs file.\n", path.c_str());
+        return false;
+    }
+    vecs->is_float = ext == ".fvecs";
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("ERROR: Can't locate the input file %s.\n", path.c_str());
+        return false;
     }
-    
-	LOG_INFO("Reading test vectors\n");
-    //height is the number of vectors
-    datah = 0;
-    while (fgets(strbuf, TEST_MAX, fin)) {
-		if (datah % 10000) LOG_FINE("    > %ld\n", datah);
-        tok = strtok(strbuf, ",");
-        dataw = 0;
-        while (tok) {
-            databuf[datah][dataw] = atof(tok);
-            tok = strtok(NULL, ",");
-            dataw++;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(int)) {
+        LOG_ERROR("ERROR: %s is empty.\n", path.c_str());
+        close(fd);
+        return false;
+    }
+    vecs->length = info.st_size;
+    void * map = mmap(NULL, vecs->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("ERROR: Can't map the input file %s.\n", path.c_str());
+        return false;
+    }
+    madvise(map, vecs->length, MADV_SEQUENTIAL);
+    const char * data = (const char *)map;
+    int dimension;
+    memcpy(&dimension, data, sizeof(int));
+    size_t row_bytes = sizeof(int) + dimension * vecs->elem;
+    bool valid = dimension > 0 && vecs->length % row_bytes == 0;
+    for (size_t at = 0; valid && at < vecs->length; at += row_bytes) {
+        int d;
+        memcpy(&d, data + at, sizeof(int));
+        valid = d == dimension;
+    }
+    if (!valid) {
+        LOG_ERROR("ERROR: %s does not hold rows of one dimension.\n", path.c_str());
+        munmap(map, vecs->length);
+        return false;
+    }
+    vecs->data = data;
+    vecs->width = dimension;
+    vecs->rows = vecs->length / row_bytes;
+    return true;
+}
+
+/* Reads component <j> of the row at <in> as a float. */
+static float vecs_value(const char * in, size_t j, size_t elem, bool is_float)
+{
+    if (elem == 1)
+        return (uint8_t)in[j];
+    if (is_float) {
+        float value;
+        memcpy(&value, in + j * sizeof(float), sizeof(float));
+        return value;
+    }
+    int value;
+    memcpy(&value, in + j * sizeof(int), sizeof(int));
+    return value;
+}
+
+/*
+ * Returns DATA_TYPE_UINT8 if the components of <vecs> are all integers in
+ * 0..255, DATA_TYPE_FLOAT if not. A .bvecs file is not scanned.
+ */
+static size_t vecs_type(const VecsMap & vecs)
+{
+    if (vecs.elem == 1)
+        return DATA_TYPE_UINT8;
+    size_t row_bytes = sizeof(int) + vecs.width * vecs.elem;
+    for (size_t i = 0; i < vecs.rows; i++) {
+        const char * in = vecs.data + i * row_bytes + sizeof(int);
+        for (size_t j = 0; j < vecs.width; j++) {
+            float value = vecs_value(in, j, vecs.elem, vecs.is_float);
+            if (!(value >= 0 && value <= 255 && value == rintf(value)))
+                return DATA_TYPE_FLOAT;
         }
-        datah++;
     }
-    fclose(fin);
-    fprintf(stderr, "  > dimensions w: %d, h: %d\n", dataw, datah);
-    filepath = data_name+TEST_LABEL_PATH;
-    fin = fopen(filepath.c_str(), "rb");
-    filepath = data_name+TST_VTR_PATH;
-    fout1 = fopen(filepath.c_str(), "wb");
-    filepath = data_name+TST_LBL_PATH;
-    fout2 = fopen(filepath.c_str(), "wb");
-    
-	LOG_INFO("Reading test labels\n");
-    labelh = 0;
-    while (fscanf(fin, "%d\n", &labelbuf[labelh]) != EOF) {
-		if (labelh % 10000) LOG_FINE("    > %ld:    %d\n", labelh, labelbuf[labelh]);
-        labelh++;
+    return DATA_TYPE_UINT8;
+}
+
+/*
+ * Streams the mapped <vecs> into the binary vector file <out_path>, with
+ * elements of the given DATA_TYPE_* <type>. Returns the number of rows
+ * written.
+ */
+static size_t convert_vecs(const VecsMap & vecs, const string & out_path, size_t type)
+{
+    size_t row_bytes = sizeof(int) + vecs.width * vecs.elem;
+    FILE * fout = fopen(out_path.c_str(), "wb");
+    if (fout == NULL) {
+        LOG_ERROR("ERROR: Can't open the output file %s.\n", out_path.c_str());
+        return 0;
+    }
+    write_vector_header(fout, vecs.rows, vecs.width, type);
+    vector<float> row (vecs.width);
+    for (size_t i = 0; i < vecs.rows; i++) {
+        const char * in = vecs.data + i * row_bytes + sizeof(int);
+        for (size_t j = 0; j < vecs.width; j++)
+            row[j] = vecs_value(in, j, vecs.elem, vecs.is_float);
+        write_elements(fout, &row[0], vecs.width, type);
+        if (i % 100000 == 0) {
+            LOG_FINE("    > %ld\n", i);
+        }
+    }
+    fclose(fout);
+    LOG_INFO("  > dimensions w: %ld, h: %ld, %s\n", vecs.width, vecs.rows,
+            type == DATA_TYPE_UINT8 ? "uint8" : "float");
+    return vecs.rows;
+}
+
+/* Writes <rows> zero labels, the data sets read by vecs carry no classes. */
+static void write_dummy_labels(const string & out_path, size_t rows)
+{
+    FILE * fout = fopen(out_path.c_str(), "wb");
+    if (fout == NULL) {
+        LOG_ERROR("ERROR: Can't open the output file %s.\n", out_path.c_str());
+        return;
     }
-    
-    //height and width at the beginning of the vector data
-    fwrite((const char *)&TEST_MAX, sizeof(size_t), 1, fout1);
-    fwrite((const char *)&WIDTH, sizeof(size_t), 1, fout1);
-    
     //only height at the begining of the label data
-    fwrite((const char *)&TEST_MAX, sizeof(size_t), 1, fout2);
-    
-    for (int i = 0; i < TEST_MAX; i++) {
-        res = (byte)labelbuf[i];
-        fwrite((const char *)&res, sizeof(byte), 1, fout2); //write in label data
-        fwrite((const char *)databuf[i], sizeof(float), WIDTH, fout1);
+    fwrite((const char *)&rows, sizeof(size_t), 1, fout);
+    vector<byte> labels (rows, 0);
+    if (rows > 0)
+        fwrite((const char *)&labels[0], sizeof(byte), rows, fout);
+    fclose(fout);
+}
+
+/*
+ * Imports the groundtruth .ivecs file <in_path>, one row of neighbor ids
+ * per query, as the k_true_nn file read by Test. Rows are truncated to
+ * their first <k> neighbors.
+ */
+static void convert_groundtruth(const string & in_path, const string & out_path,
+        size_t queries, size_t k)
+{
+    VecsMap vecs;
+    if (!map_vecs(in_path, &vecs))
+        return;
+    if (vecs.elem != sizeof(int) || vecs.rows != queries || vecs.width < k) {
+        LOG_ERROR("ERROR: %s is not an ivecs file with %ld rows of at least %ld ids.\n",
+                in_path.c_str(), queries, k);
+        munmap((void *)vecs.data, vecs.length);
+        return;
     }
-    fclose(fin);
-    fclose(fout1);
-    fclose(fout2);
+    FILE * fout = fopen(out_path.c_str(), "wb");
+    if (fout == NULL) {
+        LOG_ERROR("ERROR: Can't open the output file %s.\n", out_path.c_str());
+        munmap((void *)vecs.data, vecs.length);
+        return;
+    }
+    fwrite((const char *)&k, sizeof(size_t), 1, fout);
+    for (size_t i = 0; i < vecs.rows; i++) {
+        const char * in = vecs.data + i * (sizeof(int) + vecs.width * sizeof(int)) + sizeof(int);
+        for (size_t j = 0; j < k; j++) {
+            int id;
+            memcpy(&id, in + j * sizeof(int), sizeof(int));
+            size_t nn = id;
+            fwrite((const char *)&nn, sizeof(size_t), 1, fout);
+        }
+    }
+    fclose(fout);
+    munmap((void *)vecs.data, vecs.length);
+    LOG_INFO("  > groundtruth k: %ld, h: %ld\n", k, vecs.rows);
+}
+
+void vecs_generate(const string& data_name, const string& base_path, const string& query_path,
+        const string& truth_path, size_t k) {
+    LOG_INFO("> converting vecs data\n");
+
+    //each file is mapped and validated once, for the type scan and the conversion
+    VecsMap base, query;
+    if (!map_vecs(base_path, &base))
+        return;
+    if (!map_vecs(query_path, &query)) {
+        munmap((void *)base.data, base.length);
+        return;
+    }
+    //both files share one element type, bytes only if both fit in bytes
+    size_t type = vecs_type(base) == DATA_TYPE_UINT8 && vecs_type(query) == DATA_TYPE_UINT8 ?
+            DATA_TYPE_UINT8 : DATA_TYPE_FLOAT;
+    LOG_INFO("Reading base vectors\n");
+    size_t rows = convert_vecs(base, data_name + TRN_VTR_PATH, type);
+    munmap((void *)base.data, base.length);
+    if (rows > 0) {
+        write_dummy_labels(data_name + TRN_LBL_PATH, rows);
+        LOG_INFO("Reading query vectors\n");
+        rows = convert_vecs(query, data_name + TST_VTR_PATH, type);
+    }
+    munmap((void *)query.data, query.length);
+    if (rows == 0)
+        return;
+    write_dummy_labels(data_name + TST_LBL_PATH, rows);
+    if (!truth_path.empty()) {
+        LOG_INFO("Reading groundtruth\n");
+        convert_groundtruth(truth_path, data_name + TRUE_NN_PATH, rows, k);
+    }
+}
 
-	// De-Allocate memory to prevent memory leak
-	for (int i = 0; i < TRAIN_MAX; ++i)
-		delete[] databuf[i];
-	delete[] databuf;
+void data_generate(const string& data_name, size_t TRAIN_MAX, size_t TEST_MAX, size_t WIDTH, bool UINT8) {
+    size_t type = UINT8 ? DATA_TYPE_UINT8 : DATA_TYPE_FLOAT;
+    /* WRITE TRAIN DATA AND LABEL*/
+    LOG_INFO("> converting data\n");
+    LOG_INFO("Reading train vectors\n");
+    size_t rows = convert_vectors(data_name + TRAIN_VECTOR_PATH, data_name + TRN_VTR_PATH,
+            TRAIN_MAX, WIDTH, type);
+    if (rows == 0)
+        return;
+    LOG_INFO("Reading train labels\n");
+    convert_labels(data_name + TRAIN_LABEL_PATH, data_name + TRN_LBL_PATH, rows);
+
+    /* TEST DATA */
+    LOG_INFO("Reading test vectors\n");
+    rows = convert_vectors(data_name + TEST_VECTOR_PATH, data_name + TST_VTR_PATH,
+            TEST_MAX, WIDTH, type);
+    if (rows == 0)
+        return;
+    LOG_INFO("Reading test labels\n");
+    convert_labels(data_name + TEST_LABEL_PATH, data_name + TST_LBL_PATH, rows);
 }
@@ -11,7 +11,19 @@
 #include <string>
 using namespace std;
 
-void data_generate(const string& data_name, size_t TRAIN_MAX, size_t TEST_MAX, size_t WIDTH);
+/*
+ * Converts the csv files of <data_name>. With <UINT8> the vectors are
+ * stored as bytes, for data sets whose features are all 0..255.
+ */
+void data_generate(const string& data_name, size_t TRAIN_MAX, size_t TEST_MAX, size_t WIDTH,
+        bool UINT8 = false);
+/*
+ * Converts .fvecs/.bvecs/.ivecs base and query files of <data_name> in one
+ * pass, with dummy labels. When <truth_path> is not empty the groundtruth
+ * .ivecs is imported as k_true_nn with <k> neighbors per query.
+ */
+void vecs_generate(const string& data_name, const string& base_path, const string& query_path,
+        const string& truth_path, size_t k = 10);
 
 
 #endif
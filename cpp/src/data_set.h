@@ -9,12 +9,19 @@
 #include <fstream>
 #include <map>
 #include <algorithm>
+#include <cmath>
 #include "Eigen/Core"
 #include "Eigen/Eigenvalues"
 #include "vector_math.h"
+#include "data_type.h"
 #include "logging.h"
 using namespace std;
 
+/* Length of the random jitter added to a unit warm start of power_eigen_vector */
+#ifndef POWER_START_JITTER
+#define POWER_START_JITTER      (0.1)
+#endif
+
 /* 
  * Name             : DataSet
  * Description      : Data structure to hold the data set.
@@ -23,6 +30,9 @@ using namespace std;
  *                    vectors_  - all vectors in data set
  *                    domain_   - vectors out of vector space in data set
  * Functions(s)     : DataSet() - Default constructor
+ *                    DataSet(vector_space)
+ *                              - Creates a data set that takes over the
+ *                                given vectors
  *                    DataSet(ifstream & in)
  *                              - De-serialization constructor
  *                    ~DataSet() 
@@ -32,6 +42,7 @@ template<class Label, class T>
 class DataSet
 {
     typedef map<vector<T> *, Label> label_space;
+public:
     typedef vector<vector<T> *> vector_space;
 private:
     DataSet<Label, T> * parent_;
@@ -39,9 +50,9 @@ private:
     vector_space * vectors_;
     vector<size_t> domain_;
     DataSet(DataSet<Label, T> & parent, vector<size_t> domain);
-    DataSet(vector_space vectors);
 public:
     DataSet();
+    DataSet(vector_space vectors);
     DataSet(ifstream & in);
     ~DataSet();
     size_t size() const;
@@ -221,13 +232,44 @@ size_t ran_variance_index(DataSet<Label, T> & subset)
     
     size_t max_var_size = max_var.size();
     
-    srand((int)time(NULL));
-    size_t index = max_var[rand() % max_var_size];
+    size_t index = max_var[uniform_int_distribution<size_t>(0, max_var_size - 1)(thread_generator())];
     LOG_FINE("Exit ran_variance_index\n");
     LOG_FINE("with result = %ld \n ", index);
     return index;
 }
 
+/*
+ * Name             : sample_centered_rows
+ * Prototype        : Eigen::MatrixXd sample_centered_rows(DataSet<Label, T> &, int)
+ * Description      : Copies up to sample_size random vectors of the data
+ *                    set into the rows of a matrix and centers them.
+ * Parameter(s)     : subset      - The data set to sample from
+ *                    sample_size - The maximum number of rows
+ * Return Value     : The centered sample, one vector per row
+ */
+template<class Label, class T>
+Eigen::MatrixXd sample_centered_rows(DataSet<Label, T> & subset, int sample_size)
+{
+    int dim = int((*subset[0]).size());  /* Dimension of each vector */
+    int num = int(subset.size());        /* Number of vectors */
+
+    //random samples, a partial shuffle of the indices
+    vector<int> ran_ints;
+    for (int i=0; i<num; i++) ran_ints.push_back(i);
+    int mtx_size = min(num, sample_size);
+    for (int i = 0; i < mtx_size; i++)
+        swap(ran_ints[i], ran_ints[uniform_int_distribution<int>(i, num - 1)(thread_generator())]);
+
+    Eigen::MatrixXd mtx (mtx_size, dim);
+    for (int i = 0; i < mtx_size; i++) {
+        const vector<T> & row = *subset[ran_ints[i]];
+        for (int j = 0; j < dim; j++)
+            mtx(i, j) = (double)row[j];
+    }
+    LOG_FINE("> Subset [%d, %d] copied over\n", mtx_size, dim);
+    return mtx.rowwise() - mtx.colwise().mean();
+}
+
 /*
  * Name             : max_eigen_vector
  * Prototype        : vector<double> max_eigen_vector(DataSet<Label, T> &)
@@ -241,62 +283,103 @@ vector<double> max_eigen_vector(DataSet<Label, T> & subset, int sample_size)
 {
     LOG_FINE("Enter max_eigen_vector\n");
     LOG_FINE("with subset.size = %ld\n", subset.size());
-    /*
-    int rows = subset[0]->size();
-    int cols = subset.size();
-    */
-    int dim = int((*subset[0]).size());  /* Dimension of each vector */
     int num = int(subset.size());        /* Number of vectors */
-    
-    //random samples
-    vector<int> ran_ints;
-    for (int i=0; i<num; i++) ran_ints.push_back(i);
-    random_shuffle (ran_ints.begin(), ran_ints.end());
-    while (ran_ints.size() > sample_size) ran_ints.pop_back();
-    int mtx_size = int(ran_ints.size());
-    
-    Eigen::MatrixXd mtx = Eigen::MatrixXd::Zero(mtx_size, dim);
-    int count = 0;
-    for (size_t i = 0; i < num; i++) {
-        if (find(ran_ints.begin(), ran_ints.end(), i) != ran_ints.end()) {
-            for (size_t j = 0; j < dim; j++) {
-                mtx(count, j) = (double)(*subset[count])[j];
-            }
-            count++;
-        }
-    }
-    LOG_FINE("> Subset [%d, %d] copied over\n", mtx_size, dim);
-    Eigen::MatrixXd centered = mtx.rowwise() - mtx.colwise().mean();
+    Eigen::MatrixXd centered = sample_centered_rows(subset, sample_size);
     LOG_FINE("> Done centering...\n");
     
     //Apply PCA directly
     Eigen::MatrixXd covar    = (centered.adjoint() * centered) / (double)num;
     
-    //Pass in sample_size*sample_size to speed up calculation
-    //Eigen::MatrixXd covar    = (centered * centered.adjoint()) / (double)num;
-    
     LOG_FINE("> Done covariance...\n");
     Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(covar);
-    Eigen::MatrixXd eigVtr = eig.eigenvectors();
-    Eigen::VectorXd eigVal = eig.eigenvalues();
-    
-    double eigenval = eigVal[eigVal.size()-1];
-	//convert eigen vector back
-	//Eigen::MatrixXd oriEigVtr = centered.adjoint() * eigVtr;
-	//TODO: scale back to unit vector
-	//eigenval = 1 / sqrt(eigenval);
-    //eigVtr = eigVtr.rightCols(1) * eigenval;
-	Eigen::MatrixXd lastEigVtr = eigVtr.rightCols(1);
+    Eigen::MatrixXd lastEigVtr = eig.eigenvectors().rightCols(1);
 
     LOG_FINE("> Done eigenvectors...\n");
     vector<double> maxEigVtr;
-	for (size_t i = 0; i < dim; i++) {
+	for (size_t i = 0; i < centered.cols(); i++) {
 		maxEigVtr.push_back(lastEigVtr(i));
 	}
     LOG_FINE("Exit max_eigen_vector\n");
     return maxEigVtr;
 }
 
+/*
+ * Name             : power_eigen_vector
+ * Prototype        : vector<double> power_eigen_vector(DataSet<Label, T> &, int,
+ *                                                      const vector<double> &, double, int)
+ * Description      : Gets the top eigen vector of the sampled covariance by
+ *                    power iteration. The covariance is never formed; each
+ *                    step applies it as X^T (X v) over the centered sample,
+ *                    which costs O(sample_size * d) instead of O(d^3).
+ * Parameter(s)     : subset         - The data set to find the eigen vector of
+ *                    sample_size    - The maximum number of sampled vectors
+ *                    start          - The starting direction, e.g. the parent's,
+ *                                     jittered by POWER_START_JITTER; the
+ *                                     largest centered sample if empty
+ *                    tolerance      - Stop once the relative residual
+ *                                     ||Av - (v.Av) v|| / (v.Av) falls below
+ *                                     this
+ *                    max_iterations - Upper bound on the iterations
+ * Return Value     : The (max) eigen vector of the data set, unit length
+ */
+template<class Label, class T>
+vector<double> power_eigen_vector(DataSet<Label, T> & subset, int sample_size,
+        const vector<double> & start, double tolerance, int max_iterations)
+{
+    LOG_FINE("Enter power_eigen_vector\n");
+    LOG_FINE("with subset.size = %ld\n", subset.size());
+    Eigen::MatrixXd centered = sample_centered_rows(subset, sample_size);
+    int dim = int(centered.cols());
+
+    Eigen::VectorXd v (dim);
+    if ((int)start.size() == dim)
+        for (int i = 0; i < dim; i++)
+            v(i) = start[i];
+    else
+        v.setZero();
+    if (v.norm() > 0) {
+        /*jitter the warm start, it may sit on a low variance eigenvector*/
+        normal_distribution<double> jitter (0, POWER_START_JITTER / sqrt((double)dim));
+        v.normalize();
+        for (int i = 0; i < dim; i++)
+            v(i) += jitter(thread_generator());
+    }
+    if ((centered * v).squaredNorm() == 0) {
+        /*no usable start, begin from the sample farthest from the mean*/
+        Eigen::MatrixXd::Index far;
+        centered.rowwise().squaredNorm().maxCoeff(&far);
+        v = centered.row(far).transpose();
+    }
+    if (v.norm() == 0) {
+        LOG_FINE("Exit power_eigen_vector by degenerate subset\n");
+        v.setZero();
+        v(0) = 1;
+        return vector<double>(v.data(), v.data() + dim);
+    }
+    v.normalize();
+
+    /*
+     * Test the residual rather than the change between iterates: a start
+     * near a low variance eigenvector barely moves for a few steps, while
+     * its residual is still large against its small Rayleigh quotient.
+     */
+    int iteration = 0;
+    for (; iteration < max_iterations; iteration++) {
+        Eigen::VectorXd w = centered.transpose() * (centered * v);
+        double rayleigh = v.dot(w);
+        double norm = w.norm();
+        if (norm == 0 || rayleigh <= 0)
+            break;
+        double residual = (w - rayleigh * v).norm() / rayleigh;
+        v = w / norm;
+        if (residual < tolerance)
+            break;
+    }
+    LOG_FINE("> Done %d iterations...\n", iteration);
+    LOG_FINE("Exit power_eigen_vector\n");
+    return vector<double>(v.data(), v.data() + dim);
+}
+
 /* Private Functions */
 
 template<class Label, class T>
@@ -313,21 +396,6 @@ DataSet<Label, T>::DataSet(DataSet<Label, T> & parent, vector<size_t> domain) :
     }
 }
 
-template<class Label, class T>
-DataSet<Label, T>::DataSet(vector_space vectors) :
-  parent_ (NULL),
-  labels_ (new label_space),
-  vectors_ (new vector_space)
-{
-    LOG_FINE("DataSet Constructed\n"); 
-    LOG_FINE("with vectors.size = %ld\n", vectors.size());
-    typename vector_space::iterator itr;
-    for (itr = vectors.begin(); itr != vectors.end(); itr++) {
-        domain_.push_back((size_t)domain_.size());
-        vectors_->push_back(*itr);
-    }
-}
-
 /* Public Functions */
 
 /*
@@ -347,10 +415,35 @@ DataSet<Label, T>::DataSet() :
     LOG_FINE("with default constructor\n");
 }
 
+/*
+ * Name             : DataSet
+ * Prototype        : DataSet<Label, T>::DataSet(vector_space)
+ * Description      : Creates a data set of the given vectors, in order.
+ *                    The data set owns the vectors and deletes them.
+ * Parameter(s)     : vectors - The vectors
+ * Return Value     : Creates a data set of the vectors
+ */
+template<class Label, class T>
+DataSet<Label, T>::DataSet(vector_space vectors) :
+  parent_ (NULL),
+  labels_ (new label_space),
+  vectors_ (new vector_space)
+{
+    LOG_FINE("DataSet Constructed\n"); 
+    LOG_FINE("with vectors.size = %ld\n", vectors.size());
+    typename vector_space::iterator itr;
+    for (itr = vectors.begin(); itr != vectors.end(); itr++) {
+        domain_.push_back((size_t)domain_.size());
+        vectors_->push_back(*itr);
+    }
+}
+
 /*
  * Name             : DataSet
  * Prototype        : DataSet<Label, T>::DataSet(ifstream &)
- * Description      : De-serialization constructor.
+ * Description      : De-serialization constructor. Reads both typed files
+ *                    and legacy files, which hold floats. The set is left
+ *                    empty if the stored element type is not T.
  * Parameter(s)     : None
  * Return Value     : Creates a de-serialized data set
  */
@@ -362,15 +455,22 @@ DataSet<Label, T>::DataSet(ifstream & in) :
 {
     LOG_FINE("DataSet Constructed\n"); 
     LOG_FINE("with input stream\n");
-    size_t n, m;
+    size_t n, m, type = DATA_TYPE_FLOAT;
     in.read((char *)&n, sizeof(size_t));
+    if (n == DATA_SET_MAGIC) {
+        in.read((char *)&type, sizeof(size_t));
+        in.read((char *)&n, sizeof(size_t));
+    }
     in.read((char *)&m, sizeof(size_t));
+    if (type != data_type<T>::value) {
+        LOG_ERROR("DataSet: stored type %ld does not match type %ld\n",
+                type, data_type<T>::value);
+        return;
+    }
     for (size_t i = 0; i < n; i++)
     {
-        vector<T> * vtr = new vector<T>;
-        T * buffer = new T[m];
-        in.read((char *)buffer, sizeof(T) * m);
-        vtr->assign(buffer, buffer + m);
+        vector<T> * vtr = new vector<T>(m);
+        in.read((char *)&(*vtr)[0], sizeof(T) * m);
         domain_.push_back(domain_.size());
         vectors_->push_back(vtr);
     }
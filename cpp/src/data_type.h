@@ -0,0 +1,59 @@
+/*
+ * File             : data_type.h
+ * Summary          : Element types of the serialized data sets.
+ *                    A typed vector file starts with DATA_SET_MAGIC and the
+ *                    element type, followed by the height and width of the
+ *                    legacy layout. Files without the magic hold floats.
+ */
+#ifndef DATA_TYPE_H_
+#define DATA_TYPE_H_
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+using namespace std;
+
+#define DATA_SET_MAGIC      ((size_t)0x45505954444e4e00)
+#define DATA_TYPE_NONE      (0)
+#define DATA_TYPE_FLOAT     (1)
+#define DATA_TYPE_UINT8     (2)
+
+/*
+ * Name             : data_type
+ * Description      : Maps an element type to its DATA_TYPE_* code.
+ * Data Field(s)    : value     - The code, DATA_TYPE_NONE if not storable
+ */
+template<class T>
+struct data_type
+{ static const size_t value = DATA_TYPE_NONE; };
+
+template<>
+struct data_type<float>
+{ static const size_t value = DATA_TYPE_FLOAT; };
+
+template<>
+struct data_type<uint8_t>
+{ static const size_t value = DATA_TYPE_UINT8; };
+
+/*
+ * Name             : read_data_type
+ * Prototype        : size_t read_data_type(const string &)
+ * Description      : Reads the element type of a vector file.
+ * Parameter(s)     : path  - The path of the vector file
+ * Return Value     : The DATA_TYPE_* code of the file, DATA_TYPE_NONE if
+ *                    it cannot be read
+ */
+inline size_t read_data_type(const string & path)
+{
+    ifstream in (path, ios::binary);
+    size_t magic, type;
+    if (!in.read((char *)&magic, sizeof(size_t)))
+        return DATA_TYPE_NONE;
+    if (magic != DATA_SET_MAGIC)
+        return DATA_TYPE_FLOAT;
+    if (!in.read((char *)&type, sizeof(size_t)))
+        return DATA_TYPE_NONE;
+    return type;
+}
+
+#endif
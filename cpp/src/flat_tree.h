@@ -0,0 +1,830 @@
+/*
+ * File             : flat_tree.h
+ * Summary          : Memory-mappable flat layout of the binary trees.
+ *                    A flat tree file holds a header, a node array, a
+ *                    cold node array, a split-direction pool, a run table
+ *                    and a leaf-id pool, each section aligned to 64 bytes.
+ *                    The file is mmap'd and queried in place without any
+ *                    de-serialization. The node array keeps only what a
+ *                    descent reads, two nodes per cache line, in van Emde
+ *                    Boas order so that a root-to-leaf path touches
+ *                    O(log_B n) cache lines; the tie breakers and id runs
+ *                    sit in the cold array.
+ *                    Leaf ids are kept as sorted runs of 32-bit ids,
+ *                    delta-encoded with a stride of 4 and bit-packed in
+ *                    4 vertical lanes so a group decodes with SSE2.
+ *                    Only leaves own runs; an internal node references the
+ *                    runs of its subtree, so the ids a spill tree sends to
+ *                    both children are stored once per leaf and never per
+ *                    internal node.
+ */
+#ifndef FLAT_TREE_H_
+#define FLAT_TREE_H_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "logging.h"
+#include "data_set.h"
+#include "kd_tree.h"
+#include "pca_tree.h"
+using namespace std;
+
+#define FLAT_TREE_MAGIC         ("NNFLAT")
+#define FLAT_TREE_VERSION       (5)
+#define FLAT_TREE_ALIGN         (64)
+#define FLAT_TREE_NONE          ((uint64_t)-1)
+#define FLAT_TREE_LEAF          ((uint32_t)-1)
+#define FLAT_TREE_SEEDED        ((uint64_t)1 << 63)
+#define FLAT_TREE_KD            (1)
+#define FLAT_TREE_PCA           (2)
+#define FLAT_TREE_LANES         (4)
+#define FLAT_TREE_GROUP         (128)
+
+/*
+ * Name             : FlatTreeHeader
+ * Description      : Header at the beginning of a flat tree file.
+ * Data Field(s)    : magic         - FLAT_TREE_MAGIC, zero padded
+ *                    version       - FLAT_TREE_VERSION of the writer
+ *                    kind          - FLAT_TREE_KD or FLAT_TREE_PCA
+ *                    dimension     - The dimension of the data set
+ *                    node_count    - Number of nodes, root is node 0
+ *                    dir_count     - Number of doubles in direction pool
+ *                    run_count     - Number of id runs in the run table
+ *                    id_words      - Number of 32-bit words in leaf-id pool
+ *                    node_offset   - Byte offset of the node array
+ *                    dir_offset    - Byte offset of the direction pool
+ *                    run_offset    - Byte offset of the run table
+ *                    id_offset     - Byte offset of the leaf-id pool
+ *                    cold_offset   - Byte offset of the cold node array
+ */
+struct FlatTreeHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t dimension;
+    uint64_t node_count;
+    uint64_t dir_count;
+    uint64_t run_count;
+    uint64_t id_words;
+    uint64_t node_offset;
+    uint64_t dir_offset;
+    uint64_t run_offset;
+    uint64_t id_offset;
+    uint64_t cold_offset;
+    char reserved[32];
+};
+
+/*
+ * Name             : FlatTreeNode
+ * Description      : The part of a node read at every step of a descent,
+ *                    half a cache line.
+ * Data Field(s)    : left, right   - Child node numbers, FLAT_TREE_LEAF on leaves
+ *                    key           - The split index (kd) or the offset of
+ *                                    the projection direction (pca) in the pool
+ *                    size          - Number of distinct ids of the node; the
+ *                                    runs of a spilled node hold more
+ *                    pivot         - The value of pivot
+ *                    tie_pivot     - The value of pivot of tie breaker (kd only)
+ */
+struct FlatTreeNode
+{
+    uint32_t left;
+    uint32_t right;
+    uint32_t key;
+    uint32_t size;
+    double pivot;
+    double tie_pivot;
+};
+
+/*
+ * Name             : FlatTreeColdNode
+ * Description      : The part of a node read only on a tie or at the end of
+ *                    a descent, at the same node number as its FlatTreeNode.
+ * Data Field(s)    : tie_dir       - Offset of the tie breaker in the pool, or
+ *                                    its seed flagged with FLAT_TREE_SEEDED
+ *                                    (kd only), FLAT_TREE_NONE if none
+ *                    run           - First id run of the node
+ *                    runs          - Number of id runs of the node
+ */
+struct FlatTreeColdNode
+{
+    uint64_t tie_dir;
+    uint32_t run;
+    uint32_t runs;
+};
+
+/*
+ * Name             : FlatTreeBuildNode
+ * Description      : A node while a tree is laid out in pre-order, before
+ *                    it is split into its hot and cold parts.
+ * Data Field(s)    : left, right   - Child node numbers, FLAT_TREE_NONE on leaves
+ *                    index         - The split index (kd only)
+ *                    dir           - Offset of the tie breaker (kd) or
+ *                                    projection direction (pca) in the pool,
+ *                                    or the flagged seed of the tie breaker
+ *                    pivot         - The value of pivot
+ *                    tie_pivot     - The value of pivot of tie breaker (kd only)
+ *                    run           - First id run of the node
+ *                    runs          - Number of id runs of the node
+ *                    size          - Number of distinct ids of the node
+ */
+struct FlatTreeBuildNode
+{
+    uint64_t left;
+    uint64_t right;
+    uint64_t index;
+    uint64_t dir;
+    double pivot;
+    double tie_pivot;
+    uint32_t run;
+    uint32_t runs;
+    uint64_t size;
+};
+
+/*
+ * Name             : FlatTreeRun
+ * Description      : A sorted list of ids in the leaf-id pool. The ids are
+ *                    split in groups of up to FLAT_TREE_GROUP; each group
+ *                    is one word holding the bit width b followed by 4 lanes
+ *                    of b-bit deltas, id i going to lane i % 4. Every delta
+ *                    is taken against the id 4 positions before it.
+ * Data Field(s)    : offset        - Word offset of the first group in the pool
+ *                    count         - Number of ids in the run
+ *                    base          - Reference value of the first 4 deltas
+ */
+struct FlatTreeRun
+{
+    uint64_t offset;
+    uint32_t count;
+    uint32_t base;
+};
+
+static_assert(sizeof(FlatTreeHeader) == 2 * FLAT_TREE_ALIGN, "FlatTreeHeader must be 128 bytes");
+static_assert(sizeof(FlatTreeNode) == FLAT_TREE_ALIGN / 2, "FlatTreeNode must be 32 bytes");
+static_assert(sizeof(FlatTreeColdNode) == 16, "FlatTreeColdNode must be 16 bytes");
+static_assert(sizeof(FlatTreeRun) == 16, "FlatTreeRun must be 16 bytes");
+
+/* Class Definitions */
+
+/*
+ * Name             : FlatTree
+ * Description      : Read-only view of a mmap'd flat tree file.
+ * Data Field(s)    : length_   - Length of the mapping
+ *                    base_     - Start of the mapping
+ *                    header_   - The file header
+ *                    nodes_    - The node array
+ *                    cold_     - The cold node array
+ *                    dirs_     - The direction pool
+ *                    runs_     - The run table
+ *                    ids_      - The leaf-id pool
+ *                    st_       - Holds the data set associated with tree
+ * Function(s)      : FlatTree(const string &, DataSet<Label, T> &)
+ *                          - Maps the given flat tree file
+ *                    ~FlatTree()
+ *                          - Unmaps the file
+ *                    bool good() const
+ *                          - Whether the file was mapped and validated
+ *                    DataSet<Label, T> & get_st() const
+ *                          - Returns the set associated with the tree
+ *                    vector<size_t> subdomain(vector<T> *, size_t)
+ *                          - Queries the tree for a subdomain
+ *                    double space_blowup(size_t) const
+ *                          - Returns the ids stored in the leaves reached
+ *                            at a leaf size over the size of the data set
+ */
+template<class Label, class T>
+class FlatTree
+{
+private:
+    size_t length_;
+    void * base_;
+    const FlatTreeHeader * header_;
+    const FlatTreeNode * nodes_;
+    const FlatTreeColdNode * cold_;
+    const double * dirs_;
+    const FlatTreeRun * runs_;
+    const uint32_t * ids_;
+    DataSet<Label, T> & st_;
+    FlatTree(const FlatTree &);
+    FlatTree & operator=(const FlatTree &);
+    vector<size_t> leaf_domain(const FlatTreeNode * node) const;
+public:
+    FlatTree(const string & path, DataSet<Label, T> & st);
+    ~FlatTree();
+    bool good() const
+    { return base_ != NULL; }
+    uint32_t get_kind() const
+    { return header_->kind; }
+    size_t get_node_count() const
+    { return header_->node_count; }
+    DataSet<Label, T> & get_st() const
+    { return st_; }
+    vector<size_t> subdomain(vector<T> * query, size_t leaf_size = 0) const;
+    double space_blowup(size_t leaf_size = 0) const;
+};
+
+/* Private Functions */
+
+static uint64_t flat_align(uint64_t offset)
+{
+    return (offset + FLAT_TREE_ALIGN - 1) / FLAT_TREE_ALIGN * FLAT_TREE_ALIGN;
+}
+
+static void flat_pad(ofstream & out, uint64_t from, uint64_t to)
+{
+    static const char zeros[FLAT_TREE_ALIGN] = {0};
+    out.write(zeros, to - from);
+}
+
+static void flat_append_dir(FlatTreeBuildNode & flat, const vector<double> & dir,
+        vector<double> & dirs)
+{
+    if (dir.empty())
+        return;
+    flat.dir = dirs.size();
+    dirs.insert(dirs.end(), dir.begin(), dir.end());
+    /*keep every direction on its own cache line*/
+    while (dirs.size() % (FLAT_TREE_ALIGN / sizeof(double)))
+        dirs.push_back(0);
+}
+
+static uint32_t flat_bits(uint32_t value)
+{
+    uint32_t bits = 0;
+    while (bits < 32 && (value >> bits))
+        bits++;
+    return bits;
+}
+
+/*
+ * Appends <domain> to the leaf-id pool as one sorted run. The run is
+ * padded to a multiple of 4 ids by repeating the last id; the padding
+ * is dropped again when the run is decoded.
+ */
+static FlatTreeRun flat_pack_run(vector<size_t> domain, vector<uint32_t> & words)
+{
+    FlatTreeRun run;
+    run.offset = words.size();
+    run.count = domain.size();
+    run.base = 0;
+    if (domain.empty())
+        return run;
+    sort(domain.begin(), domain.end());
+    run.base = domain[0];
+    while (domain.size() % FLAT_TREE_LANES)
+        domain.push_back(domain.back());
+    uint32_t prev[FLAT_TREE_LANES];
+    fill(prev, prev + FLAT_TREE_LANES, run.base);
+    uint32_t delta[FLAT_TREE_GROUP];
+    for (size_t start = 0; start < domain.size(); start += FLAT_TREE_GROUP) {
+        size_t len = min((size_t)FLAT_TREE_GROUP, domain.size() - start);
+        uint32_t max_delta = 0;
+        for (size_t i = 0; i < len; i++) {
+            delta[i] = (uint32_t)domain[start + i] - prev[i % FLAT_TREE_LANES];
+            prev[i % FLAT_TREE_LANES] = domain[start + i];
+            max_delta |= delta[i];
+        }
+        uint32_t b = flat_bits(max_delta);
+        size_t lane_len = len / FLAT_TREE_LANES;
+        words.push_back(b);
+        size_t packed = words.size();
+        words.resize(packed + FLAT_TREE_LANES * ((lane_len * b + 31) / 32), 0);
+        for (size_t i = 0; i < len && b; i++) {
+            size_t bit = (i / FLAT_TREE_LANES) * b;
+            size_t at = packed + (bit / 32) * FLAT_TREE_LANES + i % FLAT_TREE_LANES;
+            words[at] |= delta[i] << (bit % 32);
+            if (bit % 32 + b > 32)
+                words[at + FLAT_TREE_LANES] |= delta[i] >> (32 - bit % 32);
+        }
+    }
+    return run;
+}
+
+/*
+ * Decodes <lane_len> rows of a group packed at <in> with bit width <b>
+ * into <out>, adding the deltas onto the running lanes <acc>.
+ */
+static void flat_unpack_group(const uint32_t * in, uint32_t b, size_t lane_len,
+        uint32_t * acc, uint32_t * out)
+{
+    uint32_t mask = b == 32 ? 0xffffffffu : (1u << b) - 1;
+#ifdef __SSE2__
+    __m128i sum = _mm_loadu_si128((const __m128i *)acc);
+    if (b) {
+        __m128i m = _mm_set1_epi32(mask);
+        for (size_t i = 0; i < lane_len; i++) {
+            size_t bit = i * b;
+            const uint32_t * w = in + (bit / 32) * FLAT_TREE_LANES;
+            uint32_t shift = bit % 32;
+            __m128i v = _mm_srl_epi32(_mm_loadu_si128((const __m128i *)w),
+                    _mm_cvtsi32_si128(shift));
+            if (shift + b > 32)
+                v = _mm_or_si128(v, _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(w + FLAT_TREE_LANES)),
+                            _mm_cvtsi32_si128(32 - shift)));
+            sum = _mm_add_epi32(sum, _mm_and_si128(v, m));
+            _mm_storeu_si128((__m128i *)(out + i * FLAT_TREE_LANES), sum);
+        }
+    }
+    else {
+        for (size_t i = 0; i < lane_len; i++)
+            _mm_storeu_si128((__m128i *)(out + i * FLAT_TREE_LANES), sum);
+    }
+    _mm_storeu_si128((__m128i *)acc, sum);
+#else
+    for (size_t i = 0; i < lane_len; i++) {
+        size_t bit = i * b;
+        const uint32_t * w = in + (bit / 32) * FLAT_TREE_LANES;
+        uint32_t shift = bit % 32;
+        for (size_t k = 0; k < FLAT_TREE_LANES; k++) {
+            uint32_t v = b ? w[k] >> shift : 0;
+            if (shift + b > 32)
+                v |= w[k + FLAT_TREE_LANES] << (32 - shift);
+            acc[k] += v & mask;
+            out[i * FLAT_TREE_LANES + k] = acc[k];
+        }
+    }
+#endif
+}
+
+/* Decodes the ids of <run> from the pool <ids> into <out>. */
+static void flat_unpack_run(const FlatTreeRun & run, const uint32_t * ids, size_t * out)
+{
+    const uint32_t * in = ids + run.offset;
+    uint32_t acc[FLAT_TREE_LANES];
+    fill(acc, acc + FLAT_TREE_LANES, run.base);
+    uint32_t group[FLAT_TREE_GROUP];
+    size_t padded = (run.count + FLAT_TREE_LANES - 1) / FLAT_TREE_LANES * FLAT_TREE_LANES;
+    for (size_t done = 0; done < padded; done += FLAT_TREE_GROUP) {
+        size_t len = min((size_t)FLAT_TREE_GROUP, padded - done);
+        size_t lane_len = len / FLAT_TREE_LANES;
+        uint32_t b = *in++;
+        flat_unpack_group(in, b, lane_len, acc, group);
+        in += FLAT_TREE_LANES * ((lane_len * b + 31) / 32);
+        size_t keep = min(len, run.count - done);
+        for (size_t i = 0; i < keep; i++)
+            out[done + i] = group[i];
+    }
+}
+
+/* Whether <count> items of <size> bytes at <offset> fit in <length> bytes. */
+static bool flat_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t length)
+{
+    return offset <= length && count <= (length - offset) / size;
+}
+
+/*
+ * Checks the nodes and runs of a mapped flat tree whose sections fit in
+ * the file. Children must come after their parent, so every descent ends;
+ * split keys and directions must lie in the direction pool, the runs of a
+ * node in the run table and the groups of a run in the leaf-id pool.
+ */
+static bool flat_valid_nodes(const FlatTreeHeader * header, const char * base)
+{
+    const FlatTreeNode * nodes = (const FlatTreeNode *)(base + header->node_offset);
+    const FlatTreeColdNode * cold = (const FlatTreeColdNode *)(base + header->cold_offset);
+    const FlatTreeRun * runs = (const FlatTreeRun *)(base + header->run_offset);
+    const uint32_t * ids = (const uint32_t *)(base + header->id_offset);
+    uint64_t dimension = header->dimension;
+    uint64_t dir_count = header->dir_count;
+    for (uint64_t i = 0; i < header->node_count; i++) {
+        const FlatTreeNode & node = nodes[i];
+        if ((uint64_t)cold[i].run + cold[i].runs > header->run_count)
+            return false;
+        if (node.left == FLAT_TREE_LEAF)
+            continue;
+        if (node.left <= i || node.right <= i ||
+            node.left >= header->node_count || node.right >= header->node_count)
+            return false;
+        if (header->kind == FLAT_TREE_KD) {
+            uint64_t tie_dir = cold[i].tie_dir;
+            if (node.key >= dimension)
+                return false;
+            if (tie_dir != FLAT_TREE_NONE && !(tie_dir & FLAT_TREE_SEEDED) &&
+                (tie_dir > dir_count || dir_count - tie_dir < dimension))
+                return false;
+        }
+        else if (node.key > dir_count || dir_count - node.key < dimension)
+            return false;
+    }
+    for (uint64_t r = 0; r < header->run_count; r++) {
+        uint64_t at = runs[r].offset;
+        uint64_t padded = ((uint64_t)runs[r].count + FLAT_TREE_LANES - 1) /
+            FLAT_TREE_LANES * FLAT_TREE_LANES;
+        for (uint64_t done = 0; done < padded; done += FLAT_TREE_GROUP) {
+            uint64_t lane_len = min((uint64_t)FLAT_TREE_GROUP, padded - done) / FLAT_TREE_LANES;
+            if (at >= header->id_words || ids[at] > 32)
+                return false;
+            uint64_t words = FLAT_TREE_LANES * ((lane_len * ids[at++] + 31) / 32);
+            if (words > header->id_words - at)
+                return false;
+            at += words;
+        }
+    }
+    return true;
+}
+
+template<class Label, class T>
+uint32_t flat_kind(const KDTreeNode<Label, T> * node)
+{
+    return FLAT_TREE_KD;
+}
+
+template<class Label, class T>
+uint32_t flat_kind(const PCATreeNode<Label, T> * node)
+{
+    return FLAT_TREE_PCA;
+}
+
+template<class Label, class T>
+void flat_split(const KDTreeNode<Label, T> * node, FlatTreeBuildNode & flat,
+        vector<double> & dirs)
+{
+    flat.index = node->get_index();
+    flat.pivot = (double)node->get_pivot();
+    flat.tie_pivot = node->get_tie_pivot();
+    if (node->is_tie_seeded())
+        flat.dir = node->get_tie_seed() | FLAT_TREE_SEEDED;
+    else
+        flat_append_dir(flat, node->get_tie_breaker(), dirs);
+}
+
+template<class Label, class T>
+void flat_split(const PCATreeNode<Label, T> * node, FlatTreeBuildNode & flat,
+        vector<double> & dirs)
+{
+    flat.pivot = node->get_pivot();
+    flat_append_dir(flat, node->get_direction(), dirs);
+}
+
+/*
+ * Lays out <node> and its subtree in pre-order. The runs of a subtree are
+ * appended contiguously, so an internal node shares its children's runs
+ * and only leaves append a run to the pool. The children of a spilled
+ * node overlap; its own ids are the union of their runs.
+ */
+template<class Node>
+uint64_t flat_append_node(const Node * node, vector<FlatTreeBuildNode> & nodes,
+        vector<double> & dirs, vector<FlatTreeRun> & runs, vector<uint32_t> & ids)
+{
+    uint64_t at = nodes.size();
+    FlatTreeBuildNode flat;
+    memset(&flat, 0, sizeof(FlatTreeBuildNode));
+    flat.left = flat.right = flat.dir = FLAT_TREE_NONE;
+    nodes.push_back(flat);
+    vector<size_t> domain = node->get_domain();
+    bool shared = false;
+    if (node->get_left() && node->get_right()) {
+        flat_split(node, flat, dirs);
+        flat.left = flat_append_node(node->get_left(), nodes, dirs, runs, ids);
+        flat.right = flat_append_node(node->get_right(), nodes, dirs, runs, ids);
+        const FlatTreeBuildNode & l = nodes[flat.left];
+        const FlatTreeBuildNode & r = nodes[flat.right];
+        shared = l.run + l.runs == r.run;
+        if (shared) {
+            flat.run = l.run;
+            flat.runs = l.runs + r.runs;
+        }
+    }
+    if (!shared) {
+        flat.run = runs.size();
+        flat.runs = 1;
+        runs.push_back(flat_pack_run(domain, ids));
+    }
+    flat.size = domain.size();
+    nodes[at] = flat;
+    return at;
+}
+
+/* Appends to <out> the nodes <depth> levels below <root>, left to right. */
+static void flat_frontier(const vector<FlatTreeBuildNode> & nodes, uint64_t root,
+        uint32_t depth, vector<uint64_t> & out)
+{
+    if (depth == 0) {
+        out.push_back(root);
+        return;
+    }
+    if (nodes[root].left == FLAT_TREE_NONE)
+        return;
+    flat_frontier(nodes, nodes[root].left, depth - 1, out);
+    flat_frontier(nodes, nodes[root].right, depth - 1, out);
+}
+
+/*
+ * Appends to <order> the nodes of the top <levels> levels under <root> in
+ * van Emde Boas order: the top half of the levels first, then each subtree
+ * hanging below it, each laid out the same way.
+ */
+static void flat_veb_order(const vector<FlatTreeBuildNode> & nodes, uint64_t root,
+        uint32_t levels, vector<uint64_t> & order)
+{
+    if (levels == 1 || nodes[root].left == FLAT_TREE_NONE) {
+        order.push_back(root);
+        return;
+    }
+    uint32_t top = levels / 2;
+    flat_veb_order(nodes, root, top, order);
+    vector<uint64_t> bottoms;
+    flat_frontier(nodes, root, top, bottoms);
+    for (size_t i = 0; i < bottoms.size(); i++)
+        flat_veb_order(nodes, bottoms[i], levels - top, order);
+}
+
+/* Public Functions */
+
+/*
+ * Name             : save_flat_tree
+ * Prototype        : bool save_flat_tree(const Tree &, ofstream &)
+ * Description      : Writes a KDTree or PCATree (or any derived tree) in
+ *                    the flat tree format.
+ * Parameter(s)     : tree  - The tree to write
+ *                    out   - The binary stream to write to
+ * Return Value     : Whether the tree was written
+ */
+template<class Tree>
+bool save_flat_tree(const Tree & tree, ofstream & out)
+{
+    LOG_INFO("Saving flat tree\n");
+    if (!tree.get_root()) {
+        LOG_ERROR("Flat Tree: cannot save an empty tree\n");
+        return false;
+    }
+    if (tree.get_st().size() > UINT32_MAX) {
+        LOG_ERROR("Flat Tree: ids of %ld points do not fit in 32 bits\n", tree.get_st().size());
+        return false;
+    }
+    vector<FlatTreeBuildNode> pre;
+    vector<double> dirs;
+    vector<FlatTreeRun> runs;
+    vector<uint32_t> ids;
+    flat_append_node(tree.get_root(), pre, dirs, runs, ids);
+    if (pre.size() >= FLAT_TREE_LEAF || dirs.size() >= FLAT_TREE_LEAF) {
+        LOG_ERROR("Flat Tree: %ld nodes do not fit in 32-bit node numbers\n", pre.size());
+        return false;
+    }
+
+    /*children come after their parent in pre-order*/
+    vector<uint32_t> levels (pre.size(), 1);
+    for (size_t i = pre.size(); i-- > 0; )
+        if (pre[i].left != FLAT_TREE_NONE)
+            levels[i] = 1 + max(levels[pre[i].left], levels[pre[i].right]);
+    vector<uint64_t> order;
+    flat_veb_order(pre, 0, levels[0], order);
+    vector<uint32_t> position (pre.size());
+    for (size_t i = 0; i < order.size(); i++)
+        position[order[i]] = i;
+
+    bool kd = flat_kind(tree.get_root()) == FLAT_TREE_KD;
+    vector<FlatTreeNode> nodes (order.size());
+    vector<FlatTreeColdNode> cold (order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        const FlatTreeBuildNode & from = pre[order[i]];
+        FlatTreeNode & hot = nodes[i];
+        hot.left = hot.right = FLAT_TREE_LEAF;
+        if (from.left != FLAT_TREE_NONE) {
+            hot.left = position[from.left];
+            hot.right = position[from.right];
+        }
+        hot.key = kd ? from.index : (from.dir == FLAT_TREE_NONE ? 0 : from.dir);
+        hot.size = from.size;
+        hot.pivot = from.pivot;
+        hot.tie_pivot = from.tie_pivot;
+        cold[i].tie_dir = kd ? from.dir : FLAT_TREE_NONE;
+        cold[i].run = from.run;
+        cold[i].runs = from.runs;
+    }
+
+    FlatTreeHeader header;
+    memset(&header, 0, sizeof(FlatTreeHeader));
+    strncpy(header.magic, FLAT_TREE_MAGIC, sizeof(header.magic));
+    header.version = FLAT_TREE_VERSION;
+    header.kind = flat_kind(tree.get_root());
+    header.dimension = tree.get_st()[0]->size();
+    header.node_count = nodes.size();
+    header.dir_count = dirs.size();
+    header.run_count = runs.size();
+    header.id_words = ids.size();
+    header.node_offset = sizeof(FlatTreeHeader);
+    header.cold_offset = flat_align(header.node_offset + nodes.size() * sizeof(FlatTreeNode));
+    header.dir_offset = flat_align(header.cold_offset + cold.size() * sizeof(FlatTreeColdNode));
+    header.run_offset = flat_align(header.dir_offset + dirs.size() * sizeof(double));
+    header.id_offset = flat_align(header.run_offset + runs.size() * sizeof(FlatTreeRun));
+
+    out.write((char *)&header, sizeof(FlatTreeHeader));
+    out.write((char *)&nodes[0], nodes.size() * sizeof(FlatTreeNode));
+    flat_pad(out, header.node_offset + nodes.size() * sizeof(FlatTreeNode), header.cold_offset);
+    out.write((char *)&cold[0], cold.size() * sizeof(FlatTreeColdNode));
+    flat_pad(out, header.cold_offset + cold.size() * sizeof(FlatTreeColdNode), header.dir_offset);
+    if (!dirs.empty())
+        out.write((char *)&dirs[0], dirs.size() * sizeof(double));
+    flat_pad(out, header.dir_offset + dirs.size() * sizeof(double), header.run_offset);
+    out.write((char *)&runs[0], runs.size() * sizeof(FlatTreeRun));
+    flat_pad(out, header.run_offset + runs.size() * sizeof(FlatTreeRun), header.id_offset);
+    if (!ids.empty())
+        out.write((char *)&ids[0], ids.size() * sizeof(uint32_t));
+    LOG_INFO("> nodes = %ld, dirs = %ld, runs = %ld, id words = %ld\n",
+            nodes.size(), dirs.size(), runs.size(), ids.size());
+    return out.good();
+}
+
+/*
+ * Name             : flat_tree_current
+ * Prototype        : bool flat_tree_current(const string &)
+ * Description      : Checks whether a file is a flat tree written by this
+ *                    version of the format.
+ * Parameter(s)     : flat_path - The path of the flat tree
+ * Return Value     : Whether the file has a current flat tree header
+ */
+static bool flat_tree_current(const string & flat_path)
+{
+    ifstream in (flat_path, ios::binary);
+    FlatTreeHeader header;
+    if (!in.read((char *)&header, sizeof(FlatTreeHeader)))
+        return false;
+    return strncmp(header.magic, FLAT_TREE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == FLAT_TREE_VERSION;
+}
+
+/*
+ * Name             : convert_flat_tree
+ * Prototype        : bool convert_flat_tree<Tree>(const string &, const string &,
+ *                                                 DataSet<Label, T> &)
+ * Description      : Converts a tree file in the BFS serialization format
+ *                    written by Tree::save into the flat tree format.
+ * Parameter(s)     : tree_path - The path of the serialized tree
+ *                    flat_path - The path of the flat tree to write
+ *                    st        - The data set associated with the tree
+ * Return Value     : Whether the tree was converted
+ */
+template<class Tree, class Label, class T>
+bool convert_flat_tree(const string & tree_path, const string & flat_path,
+        DataSet<Label, T> & st)
+{
+    ifstream tree_in (tree_path, ios::binary);
+    if (!tree_in.good()) {
+        LOG_ERROR("Flat Tree: cannot open %s\n", tree_path.c_str());
+        return false;
+    }
+    Tree tree (tree_in, st);
+    tree_in.close();
+    ofstream flat_out (flat_path, ios::binary);
+    bool saved = save_flat_tree(tree, flat_out);
+    flat_out.close();
+    return saved;
+}
+
+template<class Label, class T>
+FlatTree<Label, T>::FlatTree(const string & path, DataSet<Label, T> & st) :
+  length_ (0),
+  base_ (NULL),
+  header_ (NULL),
+  nodes_ (NULL),
+  cold_ (NULL),
+  dirs_ (NULL),
+  runs_ (NULL),
+  ids_ (NULL),
+  st_ (st)
+{
+    LOG_INFO("FlatTree Constructed\n");
+    LOG_FINE("with path = %s\n", path.c_str());
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Flat Tree: cannot open %s\n", path.c_str());
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(FlatTreeHeader)) {
+        LOG_ERROR("Flat Tree: %s is too short\n", path.c_str());
+        close(fd);
+        return;
+    }
+    void * base = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("Flat Tree: cannot map %s\n", path.c_str());
+        return;
+    }
+    const FlatTreeHeader * header = (const FlatTreeHeader *)base;
+    uint64_t length = info.st_size;
+    bool valid = strncmp(header->magic, FLAT_TREE_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == FLAT_TREE_VERSION &&
+        (header->kind == FLAT_TREE_KD || header->kind == FLAT_TREE_PCA) &&
+        header->node_count > 0 &&
+        st.size() > 0 && header->dimension == st[0]->size() &&
+        flat_fits(header->node_offset, header->node_count, sizeof(FlatTreeNode), length) &&
+        flat_fits(header->cold_offset, header->node_count, sizeof(FlatTreeColdNode), length) &&
+        flat_fits(header->dir_offset, header->dir_count, sizeof(double), length) &&
+        flat_fits(header->run_offset, header->run_count, sizeof(FlatTreeRun), length) &&
+        flat_fits(header->id_offset, header->id_words, sizeof(uint32_t), length) &&
+        flat_valid_nodes(header, (const char *)base);
+    if (!valid) {
+        LOG_ERROR("Flat Tree: %s is not a version %d flat tree of this data set\n",
+                path.c_str(), FLAT_TREE_VERSION);
+        munmap(base, info.st_size);
+        return;
+    }
+    length_ = info.st_size;
+    base_ = base;
+    header_ = header;
+    nodes_ = (const FlatTreeNode *)((const char *)base + header->node_offset);
+    cold_ = (const FlatTreeColdNode *)((const char *)base + header->cold_offset);
+    dirs_ = (const double *)((const char *)base + header->dir_offset);
+    runs_ = (const FlatTreeRun *)((const char *)base + header->run_offset);
+    ids_ = (const uint32_t *)((const char *)base + header->id_offset);
+}
+
+template<class Label, class T>
+FlatTree<Label, T>::~FlatTree()
+{
+    if (base_) munmap(base_, length_);
+    LOG_INFO("FlatTree Deconstructed\n");
+}
+
+/* Decodes the distinct ids stored under <node>. */
+template<class Label, class T>
+vector<size_t> FlatTree<Label, T>::leaf_domain(const FlatTreeNode * node) const
+{
+    const FlatTreeColdNode & cold = cold_[node - nodes_];
+    size_t filled = 0;
+    for (uint32_t r = cold.run; r < cold.run + cold.runs; r++)
+        filled += runs_[r].count;
+    vector<size_t> domain (filled);
+    filled = 0;
+    for (uint32_t r = cold.run; r < cold.run + cold.runs; r++) {
+        if (runs_[r].count == 0)
+            continue;
+        flat_unpack_run(runs_[r], ids_, &domain[filled]);
+        filled += runs_[r].count;
+    }
+    /*spilled ids reached through both children*/
+    if (filled > node->size) {
+        sort(domain.begin(), domain.end());
+        domain.erase(unique(domain.begin(), domain.end()), domain.end());
+    }
+    return domain;
+}
+
+template<class Label, class T>
+vector<size_t> FlatTree<Label, T>::subdomain(vector<T> * query, size_t leaf_size) const
+{
+    LOG_FINE("Enter subdomain\n");
+    LOG_FINE("with leaf_size = %ld\n", leaf_size);
+    if (!base_)
+        return vector<size_t>();
+    size_t dimension = header_->dimension;
+    const FlatTreeNode * cur = nodes_;
+    if (header_->kind == FLAT_TREE_KD) {
+        while (cur->left != FLAT_TREE_LEAF && cur->size >= leaf_size) {
+            double value = (double)(*query)[cur->key];
+            bool go_left = value < cur->pivot;
+            if (value == cur->pivot) {
+                uint64_t tie_dir = cold_[cur - nodes_].tie_dir;
+                double product = 0;
+                if (tie_dir != FLAT_TREE_NONE && (tie_dir & FLAT_TREE_SEEDED))
+                    product = seeded_dot(*query, tie_dir & ~FLAT_TREE_SEEDED, dimension);
+                else if (tie_dir != FLAT_TREE_NONE)
+                    product = dot(*query, dirs_ + tie_dir, dimension);
+                go_left = product <= cur->tie_pivot;
+            }
+            cur = nodes_ + (go_left ? cur->left : cur->right);
+        }
+    }
+    else {
+        while (cur->left != FLAT_TREE_LEAF && cur->size >= leaf_size)
+            cur = nodes_ + (dot(*query, dirs_ + cur->key, dimension) <= cur->pivot ?
+                    cur->left : cur->right);
+    }
+    LOG_FINE("Exit subdomain\n");
+    return leaf_domain(cur);
+}
+
+template<class Label, class T>
+double FlatTree<Label, T>::space_blowup(size_t leaf_size) const
+{
+    if (!base_ || !nodes_[0].size)
+        return 0;
+    size_t stored = 0;
+    vector<uint64_t> expl (1, 0);
+    while (!expl.empty()) {
+        const FlatTreeNode * cur = nodes_ + expl.back();
+        expl.pop_back();
+        if (cur->left != FLAT_TREE_LEAF && cur->size >= leaf_size) {
+            expl.push_back(cur->left);
+            expl.push_back(cur->right);
+        }
+        else
+            stored += cur->size;
+    }
+    return 1. * stored / nodes_[0].size;
+}
+
+#endif
@@ -0,0 +1,421 @@
+/*
+ * File             : forest.h
+ * Summary          : A set of trees of one kind over one data set. The trees
+ *                    are built and loaded on several threads sharing the
+ *                    read-only data set, and saved together as one bundle
+ *                    file so they can stay resident for every evaluation.
+ *                    A single query can be spread over the trees and the
+ *                    scan of their candidates on a WorkerPool, and the scan
+ *                    can be limited to the candidates most trees agree on.
+ *                    Forests of PCA, RP or V^2 trees can also be probed
+ *                    past one leaf per tree, most ambiguous branch first.
+ */
+#ifndef FOREST_H_
+#define FOREST_H_
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "data_set.h"
+#include "logging.h"
+#include "worker_pool.h"
+using namespace std;
+
+/* First word of a bundle file, "NNFOREST" */
+#define FOREST_MAGIC 0x4e4e464f52455354ULL
+
+/* Fewest candidates scanned by one part of a parallel search */
+#define FOREST_SCAN_CHUNK 512
+
+/* Public Functions */
+
+/*
+ * Name             : forest_threads
+ * Prototype        : size_t forest_threads(size_t)
+ * Description      : Number of threads to build or load trees on.
+ * Parameter(s)     : tree_count - The number of trees
+ * Return Value     : The number of threads, at least 1
+ */
+inline size_t forest_threads(size_t tree_count)
+{
+    size_t cores = thread::hardware_concurrency();
+    return max((size_t)1, min(tree_count, cores ? cores : (size_t)1));
+}
+
+/*
+ * Name             : save_tree_bundle
+ * Prototype        : void save_tree_bundle(const vector<const Tree *> &, ofstream &)
+ * Description      : Saves trees as one bundle: the magic, the number of
+ *                    trees, the offset of every tree and then the trees as
+ *                    each of them saves itself.
+ * Parameter(s)     : trees - The trees to save
+ *                    out   - The stream to save to
+ * Return Value     : None
+ */
+template<class Tree>
+void save_tree_bundle(const vector<const Tree *> & trees, ofstream & out)
+{
+    uint64_t magic = FOREST_MAGIC;
+    uint64_t tree_count = trees.size();
+    vector<uint64_t> offsets (tree_count);
+    streampos start = out.tellp();
+    out.write((char *)&magic, sizeof(uint64_t));
+    out.write((char *)&tree_count, sizeof(uint64_t));
+    streampos table = out.tellp();
+    out.write((char *)offsets.data(), sizeof(uint64_t) * tree_count);
+    for (size_t i = 0; i < tree_count; i++) {
+        offsets[i] = (uint64_t)(out.tellp() - start);
+        trees[i]->save(out);
+    }
+    streampos end = out.tellp();
+    out.seekp(table);
+    out.write((char *)offsets.data(), sizeof(uint64_t) * tree_count);
+    out.seekp(end);
+}
+
+/* Class Definitions */
+
+template<class Tree>
+class Forest;
+
+/*
+ * Name             : Forest
+ * Description      : Holds the trees of a forest, as Forest<RKDTree<Label, T> >
+ *                    or any tree type of the same shape.
+ * Data Field(s)    : trees_ - The trees
+ *                    st_    - The data set shared by the trees
+ * Function(s)      : Forest(size_t, DataSet<Label, T> &, Args...)
+ *                          - Builds the trees concurrently, each as
+ *                            Tree(args..., st)
+ *                    Forest(const string &, DataSet<Label, T> &)
+ *                          - Loads the trees of a bundle concurrently
+ *                    ~Forest()
+ *                          - Deconstructor
+ *                    size_t size() const
+ *                          - Returns the number of trees
+ *                    Tree & get_tree(size_t) const
+ *                          - Returns a tree of the forest
+ *                    bool good() const
+ *                          - Whether every tree was built or loaded
+ *                    void save(ofstream &) const
+ *                          - Serializes the trees as one bundle
+ *                    vector<size_t> candidates(vector<T> *, size_t, size_t, WorkerPool *, size_t) const
+ *                          - Returns the union of the subdomains of a query
+ *                            in the first trees, one tree per pool part,
+ *                            or its most voted part under a budget
+ *                    vector<size_t> probe_candidates(vector<T> *, size_t, size_t, size_t) const
+ *                          - Returns the leaves of a query in the first
+ *                            trees and behind the most ambiguous branches
+ *                            across them, for trees of PCATreeNodes
+ *                    vector<T> * scan(vector<T> *, const vector<size_t> &, WorkerPool *) const
+ *                          - Returns the nearest of a set of candidates,
+ *                            scanning them in parallel chunks
+ *                    vector<T> * search(vector<T> *, size_t, size_t, WorkerPool *, size_t *, size_t) const
+ *                          - Returns the nearest candidate of a query
+ */
+template<template<class, class> class TreeType, class Label, class T>
+class Forest<TreeType<Label, T> >
+{
+    typedef TreeType<Label, T> Tree;
+private:
+    vector<Tree *> trees_;
+    DataSet<Label, T> & st_;
+    Forest(const Forest &);
+    Forest & operator=(const Forest &);
+    template<class Task>
+    static void run(size_t tree_count, Task task);
+public:
+    template<class... Args>
+    Forest(size_t tree_count, DataSet<Label, T> & st, Args... args);
+    Forest(const string & path, DataSet<Label, T> & st);
+    ~Forest();
+    size_t size() const
+    { return trees_.size(); }
+    Tree & get_tree(size_t index) const
+    { return *trees_[index]; }
+    bool good() const
+    { return !trees_.empty(); }
+    void save(ofstream & out) const;
+    vector<size_t> candidates(vector<T> * query, size_t leaf_size, size_t tree_count,
+            WorkerPool * pool = NULL, size_t budget = 0) const;
+    vector<size_t> probe_candidates(vector<T> * query, size_t leaf_size, size_t tree_count,
+            size_t leaf_budget) const;
+    vector<T> * scan(vector<T> * query, const vector<size_t> & domain, WorkerPool * pool = NULL) const;
+    vector<T> * search(vector<T> * query, size_t leaf_size, size_t tree_count,
+            WorkerPool * pool = NULL, size_t * candidate_count = NULL, size_t budget = 0) const;
+};
+
+/* Private Functions */
+
+/*
+ * Name             : run
+ * Prototype        : void run(size_t, Task)
+ * Description      : Calls task(i) for every tree index i, spread over
+ *                    forest_threads(tree_count) threads taking the next
+ *                    index in turn.
+ * Parameter(s)     : tree_count - The number of trees
+ *                    task       - The work of one tree
+ * Return Value     : None
+ */
+template<template<class, class> class TreeType, class Label, class T>
+template<class Task>
+void Forest<TreeType<Label, T> >::run(size_t tree_count, Task task)
+{
+    atomic<size_t> next (0);
+    vector<thread> workers;
+    for (size_t w = 0; w < forest_threads(tree_count); w++) {
+        workers.push_back(thread([&]() {
+            for (size_t i = next++; i < tree_count; i = next++)
+                task(i);
+        }));
+    }
+    for (size_t w = 0; w < workers.size(); w++)
+        workers[w].join();
+}
+
+/* Public Functions */
+
+template<template<class, class> class TreeType, class Label, class T>
+template<class... Args>
+Forest<TreeType<Label, T> >::Forest(size_t tree_count, DataSet<Label, T> & st, Args... args) :
+  trees_ (tree_count, (Tree *)NULL),
+  st_ (st)
+{
+    LOG_INFO("Forest Constructed\n");
+    LOG_FINE("with tree_count = %ld\n", tree_count);
+    run(tree_count, [&](size_t i) {
+        trees_[i] = new Tree(args..., st);
+    });
+}
+
+template<template<class, class> class TreeType, class Label, class T>
+Forest<TreeType<Label, T> >::Forest(const string & path, DataSet<Label, T> & st) :
+  st_ (st)
+{
+    LOG_INFO("Forest Constructed\n");
+    LOG_FINE("with path = %s\n", path.c_str());
+    ifstream in (path, ios::binary);
+    uint64_t magic = 0;
+    uint64_t tree_count = 0;
+    in.read((char *)&magic, sizeof(uint64_t));
+    in.read((char *)&tree_count, sizeof(uint64_t));
+    if (!in.good() || magic != FOREST_MAGIC) {
+        LOG_WARNING("File %s is not a forest bundle!!!\n", path.c_str());
+        return;
+    }
+    vector<uint64_t> offsets (tree_count);
+    in.read((char *)offsets.data(), sizeof(uint64_t) * tree_count);
+    in.close();
+    trees_.assign(tree_count, (Tree *)NULL);
+    run(tree_count, [&](size_t i) {
+        ifstream tree_in (path, ios::binary);
+        tree_in.seekg(offsets[i]);
+        trees_[i] = new Tree(tree_in, st);
+    });
+}
+
+template<template<class, class> class TreeType, class Label, class T>
+Forest<TreeType<Label, T> >::~Forest()
+{
+    for (size_t i = 0; i < trees_.size(); i++)
+        delete trees_[i];
+    LOG_INFO("Forest Deconstructed\n");
+}
+
+template<template<class, class> class TreeType, class Label, class T>
+void Forest<TreeType<Label, T> >::save(ofstream & out) const
+{
+    save_tree_bundle(vector<const Tree *>(trees_.begin(), trees_.end()), out);
+}
+
+/*
+ * Name             : candidates
+ * Prototype        : vector<size_t> candidates(vector<T> *, size_t, size_t, WorkerPool *, size_t) const
+ * Description      : Queries the first trees of the forest, on the pool if
+ *                    one is given, and merges their subdomains. Under a
+ *                    budget only the candidates reached by the most trees
+ *                    are kept, ties going to the lower index, since a
+ *                    point sharing a leaf with the query in many random
+ *                    trees is likely one of its near neighbors.
+ * Parameter(s)     : query      - The query
+ *                    leaf_size  - The leaf size of each tree's subdomain
+ *                    tree_count - The number of trees to query
+ *                    pool       - The pool to query the trees on, or NULL
+ *                    budget     - The most candidates to keep, 0 for all
+ * Return Value     : The sorted indices kept, each once
+ */
+template<template<class, class> class TreeType, class Label, class T>
+vector<size_t> Forest<TreeType<Label, T> >::candidates(vector<T> * query, size_t leaf_size,
+        size_t tree_count, WorkerPool * pool, size_t budget) const
+{
+    tree_count = min(tree_count, trees_.size());
+    vector<vector<size_t> > parts (tree_count);
+    function<void(size_t)> task = [&](size_t i) {
+        parts[i] = trees_[i]->subdomain(query, leaf_size);
+    };
+    if (pool)
+        pool->run(tree_count, task);
+    else
+        for (size_t i = 0; i < tree_count; i++)
+            task(i);
+    size_t total = 0;
+    for (size_t i = 0; i < tree_count; i++)
+        total += parts[i].size();
+    vector<size_t> domain;
+    domain.reserve(total);
+    for (size_t i = 0; i < tree_count; i++)
+        domain.insert(domain.end(), parts[i].begin(), parts[i].end());
+    sort(domain.begin(), domain.end());
+    if (!budget || budget >= domain.size()) {
+        domain.erase(unique(domain.begin(), domain.end()), domain.end());
+        return domain;
+    }
+
+    //Count the votes of each index, then keep the most voted ones
+    vector<pair<size_t, size_t> > votes;
+    for (size_t i = 0; i < domain.size(); i++) {
+        if (votes.empty() || votes.back().second != domain[i])
+            votes.push_back(make_pair((size_t)0, domain[i]));
+        votes.back().first++;
+    }
+    domain.clear();
+    if (budget < votes.size()) {
+        stable_sort(votes.begin(), votes.end(),
+                [](const pair<size_t, size_t> & a, const pair<size_t, size_t> & b)
+                { return a.first > b.first; });
+        votes.resize(budget);
+    }
+    for (size_t i = 0; i < votes.size(); i++)
+        domain.push_back(votes[i].second);
+    sort(domain.begin(), domain.end());
+    return domain;
+}
+
+/*
+ * Name             : probe_candidates
+ * Prototype        : vector<size_t> probe_candidates(vector<T> *, size_t, size_t, size_t) const
+ * Description      : Multi-probe query of the first trees, which hold
+ *                    PCATreeNodes. Every branch not taken on the way down
+ *                    goes into one queue shared by all trees, keyed by the
+ *                    query's distance |q . dir - pivot| / |dir| to the split
+ *                    hyperplane of its parent. The
+ *                    path of each tree is walked first, then the queued
+ *                    branch of least margin is walked down to a leaf and
+ *                    so on, until leaf_budget leaves are reached.
+ * Parameter(s)     : query       - The query
+ *                    leaf_size   - The leaf size of each tree's subdomain
+ *                    tree_count  - The number of trees to query
+ *                    leaf_budget - The number of leaves to reach in all
+ * Return Value     : The sorted indices of the leaves reached, each once
+ */
+template<template<class, class> class TreeType, class Label, class T>
+vector<size_t> Forest<TreeType<Label, T> >::probe_candidates(vector<T> * query, size_t leaf_size,
+        size_t tree_count, size_t leaf_budget) const
+{
+    typedef pair<double, const PCATreeNode<Label, T> *> branch;
+    tree_count = min(tree_count, trees_.size());
+    priority_queue<branch, vector<branch>, greater<branch> > branches;
+    for (size_t i = 0; i < tree_count; i++)
+        branches.push(branch(-1, trees_[i]->get_root()));
+    vector<size_t> domain;
+    for (size_t leaves = 0; leaves < leaf_budget && !branches.empty(); leaves++) {
+        const PCATreeNode<Label, T> * cur = branches.top().second;
+        branches.pop();
+        while (cur->get_left() && cur->get_right() && cur->get_domain().size() >= leaf_size) {
+            double margin = cur->margin(*query);
+            if (margin <= 0) {
+                branches.push(branch(-margin, cur->get_right()));
+                cur = cur->get_left();
+            }
+            else {
+                branches.push(branch(margin, cur->get_left()));
+                cur = cur->get_right();
+            }
+        }
+        const vector<size_t> & leaf = cur->get_domain();
+        domain.insert(domain.end(), leaf.begin(), leaf.end());
+    }
+    sort(domain.begin(), domain.end());
+    domain.erase(unique(domain.begin(), domain.end()), domain.end());
+    return domain;
+}
+
+/*
+ * Name             : scan
+ * Prototype        : vector<T> * scan(vector<T> *, const vector<size_t> &, WorkerPool *) const
+ * Description      : Finds the nearest of a set of candidates. With a pool
+ *                    the candidates are scanned in up to one chunk per
+ *                    thread of at least FOREST_SCAN_CHUNK points. Ties go
+ *                    to the first candidate, so the answer does not depend
+ *                    on the pool.
+ * Parameter(s)     : query  - The query
+ *                    domain - The candidates
+ *                    pool   - The pool to scan on, or NULL
+ * Return Value     : The nearest candidate, NULL if there is none
+ */
+template<template<class, class> class TreeType, class Label, class T>
+vector<T> * Forest<TreeType<Label, T> >::scan(vector<T> * query, const vector<size_t> & domain,
+        WorkerPool * pool) const
+{
+    if (domain.empty())
+        return NULL;
+    size_t chunk_count = 1;
+    if (pool)
+        chunk_count = max((size_t)1, min(pool->size(), domain.size() / FOREST_SCAN_CHUNK));
+    vector<size_t> best (chunk_count);
+    vector<double> best_distance (chunk_count);
+    function<void(size_t)> scan_chunk = [&](size_t c) {
+        size_t begin = domain.size() * c / chunk_count;
+        size_t end = domain.size() * (c + 1) / chunk_count;
+        best[c] = begin;
+        best_distance[c] = distance_to(query, st_[domain[begin]]);
+        for (size_t i = begin + 1; i < end; i++) {
+            double distance = distance_to(query, st_[domain[i]]);
+            if (distance < best_distance[c]) {
+                best_distance[c] = distance;
+                best[c] = i;
+            }
+        }
+    };
+    if (pool)
+        pool->run(chunk_count, scan_chunk);
+    else
+        scan_chunk(0);
+    size_t nearest = 0;
+    for (size_t c = 1; c < chunk_count; c++)
+        if (best_distance[c] < best_distance[nearest])
+            nearest = c;
+    return st_[domain[best[nearest]]];
+}
+
+/*
+ * Name             : search
+ * Prototype        : vector<T> * search(vector<T> *, size_t, size_t, WorkerPool *, size_t *, size_t) const
+ * Description      : Finds the nearest of the candidates of a query, see
+ *                    candidates and scan.
+ * Parameter(s)     : query           - The query
+ *                    leaf_size       - The leaf size of each tree's subdomain
+ *                    tree_count      - The number of trees to query
+ *                    pool            - The pool to search on, or NULL
+ *                    candidate_count - Increased by the number of candidates
+ *                                      scanned, if not NULL
+ *                    budget          - The most candidates to scan, picked
+ *                                      by votes, 0 for all
+ * Return Value     : The nearest candidate, NULL if there is none
+ */
+template<template<class, class> class TreeType, class Label, class T>
+vector<T> * Forest<TreeType<Label, T> >::search(vector<T> * query, size_t leaf_size,
+        size_t tree_count, WorkerPool * pool, size_t * candidate_count, size_t budget) const
+{
+    vector<size_t> domain = candidates(query, leaf_size, tree_count, pool, budget);
+    if (candidate_count)
+        *candidate_count += domain.size();
+    return scan(query, domain, pool);
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * File             : kd_skeleton.h
+ * Summary          : Partition skeleton shared by the kd and kd virtual
+ *                    spill trees. The skeleton is the median kd partition
+ *                    of a data set together with, for every spill factor
+ *                    asked for, the quantile keys bounding the spill band
+ *                    of each split. Virtual spill trees of every spill
+ *                    factor are derived from it without re-computing the
+ *                    split statistics. Spill trees are not: below a split
+ *                    their children hold the spilled domains, whose own
+ *                    medians and bands differ from those of the unspilled
+ *                    partition.
+ */
+#ifndef KD_SKELETON_H_
+#define KD_SKELETON_H_
+
+#include <algorithm>
+#include <map>
+#include <queue>
+#include "kd_tree.h"
+using namespace std;
+
+/* Class Definitions */
+
+/*
+ * Name             : KDSplitRange
+ * Description      : Spill band of one split at its split index, as a
+ *                    virtual spill tree reads it: a query of value in
+ *                    [lo, hi) explores both children.
+ * Data Field(s)    : lo    - Lower end of the band
+ *                    hi    - Upper end of the band
+ */
+template<class T>
+struct KDSplitRange
+{
+    T lo;
+    T hi;
+};
+
+/*
+ * Name             : KDSkeleton
+ * Description      : A KDTree of the data set plus the spill bands of its
+ *                    splits for a set of spill factors.
+ * Data Field(s)    : min_leaf_size_ - The min leaf size of the partition
+ *                    tree_          - The median partition
+ *                    ranges_        - Spill bands by spill factor and node
+ * Function(s)      : KDSkeleton(size_t, const double *, size_t, DataSet<Label, T> &)
+ *                          - Builds the partition and the bands of the
+ *                            given spill factors
+ *                    size_t get_min_leaf_size() const
+ *                          - Returns the min leaf size of the partition
+ *                    const KDTree<Label, T> & get_tree() const
+ *                          - Returns the median partition
+ *                    bool has_spill_factor(double) const
+ *                          - Whether the bands of a spill factor are known
+ *                    const KDSplitRange<T> & get_range(double, const KDTreeNode<Label, T> *) const
+ *                          - Returns the band of a split for a spill factor
+ */
+template<class Label, class T>
+class KDSkeleton
+{
+    typedef map<const KDTreeNode<Label, T> *, KDSplitRange<T> > range_map;
+private:
+    size_t min_leaf_size_;
+    KDTree<Label, T> tree_;
+    map<double, range_map> ranges_;
+    KDSkeleton(const KDSkeleton &);
+    KDSkeleton & operator=(const KDSkeleton &);
+public:
+    KDSkeleton(size_t min_leaf_size, const double * spill_factors, size_t spill_factor_count,
+            DataSet<Label, T> & st);
+    size_t get_min_leaf_size() const
+    { return min_leaf_size_; }
+    const KDTree<Label, T> & get_tree() const
+    { return tree_; }
+    bool has_spill_factor(double spill_factor) const
+    { return ranges_.count(spill_factor) > 0; }
+    const KDSplitRange<T> & get_range(double spill_factor, const KDTreeNode<Label, T> * node) const
+    { return ranges_.at(spill_factor).at(node); }
+};
+
+/* Public Functions */
+
+/*
+ * The bands are the values of rank n (0.5 - a) and n (0.5 + a) of the n
+ * values at the split index, as KDVirtualSpillTree::node_ranges sets them,
+ * read off one sort of the values for every spill factor.
+ */
+template<class Label, class T>
+KDSkeleton<Label, T>::KDSkeleton(size_t min_leaf_size, const double * spill_factors,
+        size_t spill_factor_count, DataSet<Label, T> & st) :
+  min_leaf_size_ (min_leaf_size),
+  tree_ (min_leaf_size, st)
+{
+    LOG_INFO("KDSkeleton Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, %ld spill factors\n", min_leaf_size, spill_factor_count);
+    queue<const KDTreeNode<Label, T> *> to_update;
+    to_update.push(tree_.get_root());
+    while (!to_update.empty()) {
+        const KDTreeNode<Label, T> * cur = to_update.front();
+        to_update.pop();
+        if (!cur || !cur->get_left() || !cur->get_right())
+            continue;
+        const vector<size_t> & domain = cur->get_domain();
+        size_t index = cur->get_index();
+        vector<T> values (domain.size());
+        for (size_t i = 0; i < domain.size(); i++)
+            values[i] = (*st[domain[i]])[index];
+        sort(values.begin(), values.end());
+        for (size_t a = 0; a < spill_factor_count; a++) {
+            double spill_factor = spill_factors[a];
+            size_t k_l = (size_t)(values.size() * (0.5 - spill_factor));
+            size_t k_r = (size_t)(values.size() * (0.5 + spill_factor));
+            KDSplitRange<T> & r = ranges_[spill_factor][cur];
+            r.lo = values[k_l ? min(k_l, values.size()) - 1 : 0];
+            r.hi = values[k_r ? min(k_r, values.size()) - 1 : 0];
+        }
+        to_update.push(cur->get_left());
+        to_update.push(cur->get_right());
+    }
+}
+
+#endif
@@ -25,6 +25,10 @@ class KDSpillTree;
  * Functions(s)     : KDSpillTree(size_t, double, DataSet<Label, T> &)
  *                          - Creates a spill tree with given min leaf size
  *                            and the spill factor
+ *                    KDSpillTree(size_t, double, double, DataSet<Label, T> &)
+ *                          - Creates a spill tree whose spill factor, at
+ *                            most the given one, adapts per node to keep
+ *                            the space blowup within a budget
  *                    KDSpillTree(ifStream & in, DataSet<Label, T> & st)
  *                          - De-serializes a spill tree
  */
@@ -33,10 +37,11 @@ class KDSpillTree : public KDTree<Label, T>
 {
 private:
     static KDTreeNode<Label, T> * build_tree(size_t min_leaf_size, double spill_factor,
-            DataSet<Label, T> & st, vector<size_t> domain);
+            DataSet<Label, T> & st, vector<size_t> domain, double budget = 0);
 public:
 	KDSpillTree(DataSet<Label, T> & st);
     KDSpillTree(size_t min_leaf_size, double a_value, DataSet<Label, T> & st);
+    KDSpillTree(size_t min_leaf_size, double a_value, double max_blowup, DataSet<Label, T> & st);
     KDSpillTree(ifstream & in, DataSet<Label, T> & st);
 };
 
@@ -44,7 +49,7 @@ public:
 
 template<class Label, class T>
 KDTreeNode<Label, T> * KDSpillTree<Label, T>::build_tree(size_t min_leaf_size, double spill_factor,
-        DataSet<Label, T> & st, vector<size_t> domain)
+        DataSet<Label, T> & st, vector<size_t> domain, double budget)
 {
     LOG_FINE("Enter build_tree\n");
     LOG_FINE("with min_leaf_size = %ld and domain.size = %ld\n", min_leaf_size, domain.size());
@@ -64,8 +69,14 @@ KDTreeNode<Label, T> * KDSpillTree<Label, T>::build_tree(size_t min_leaf_size, d
         values.push_back((*subst[i])[mx_var_index]);
     
 	/*find size limit for spill, left/right child, and half child*/
-    size_t spill_size_lim = (size_t)(values.size() * spill_factor * 2);
-    size_t child_size_lim = (size_t)(values.size() * (0.5 - spill_factor));
+    /*spill less than spill_factor where a budget is left to spend*/
+    double a_value = spill_factor;
+    if (budget > 0)
+        a_value = budget_spill_factor(values, spill_factor, budget, min_leaf_size);
+    LOG_FINE("> spill factor = %lf\n", a_value);
+
+    size_t spill_size_lim = (size_t)(values.size() * a_value * 2);
+    size_t child_size_lim = max((size_t)1, (size_t)(values.size() * (0.5 - a_value)));
     size_t half_size_lim = (size_t)(values.size() * 0.5);
 
     double pivot = selector(values, half_size_lim);
@@ -110,7 +121,8 @@ KDTreeNode<Label, T> * KDSpillTree<Label, T>::build_tree(size_t min_leaf_size, d
     /*Distribute values in pools by doing tie breaking
     dot a random vector then do split again*/
     size_t dimension = (*subst[0]).size();
-    vector<double> tie_breaker = random_tie_breaker(dimension);
+    uint64_t tie_seed = random_tie_seed();
+    vector<double> tie_breaker = seeded_tie_breaker(tie_seed, dimension);
     
     /*extract the vectors from dataset*/
     DataSet<Label, T> left_pool_vectors = st.subset(pivot_l_pool);
@@ -232,9 +244,12 @@ KDTreeNode<Label, T> * KDSpillTree<Label, T>::build_tree(size_t min_leaf_size, d
     }
 
     KDTreeNode<Label, T> * result = new KDTreeNode<Label, T>
-            (mx_var_index, pivot, domain, dimension, tie_pivot, tie_breaker);
-    result->set_left(build_tree(min_leaf_size, spill_factor, st, subdomain_l));
-    result->set_right(build_tree(min_leaf_size, spill_factor, st, subdomain_r));
+            (mx_var_index, pivot, domain, dimension, tie_pivot, tie_seed);
+    double child_budget = 0;
+    if (budget > 0)
+        child_budget = budget * domain.size() / (subdomain_l.size() + subdomain_r.size());
+    result->set_left(build_tree(min_leaf_size, spill_factor, st, subdomain_l, child_budget));
+    result->set_right(build_tree(min_leaf_size, spill_factor, st, subdomain_r, child_budget));
     LOG_FINE("> sdl = %ld\n", subdomain_l.size());
     LOG_FINE("> sdr = %ld\n", subdomain_r.size());
     LOG_FINE("Exit build_tree\n");
@@ -260,6 +275,17 @@ KDSpillTree<Label, T>::KDSpillTree(size_t min_leaf_size, double spill_factor, Da
     this->set_root(build_tree(min_leaf_size, spill_factor, st, st.get_domain()));
 }
 
+template<class Label, class T>
+KDSpillTree<Label, T>::KDSpillTree(size_t min_leaf_size, double spill_factor, double max_blowup,
+        DataSet<Label, T> & st) :
+  KDTree<Label, T>(st)
+{
+    LOG_INFO("KDSpillTree Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, spill_factor = %lf, max_blowup = %lf\n",
+            min_leaf_size, spill_factor, max_blowup);
+    this->set_root(build_tree(min_leaf_size, spill_factor, st, st.get_domain(), max_blowup));
+}
+
 template<class Label, class T>
 KDSpillTree<Label, T>::KDSpillTree(ifstream & in, DataSet<Label, T> & st) :
   KDTree<Label, T>(in, st)
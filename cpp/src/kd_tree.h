@@ -12,6 +12,15 @@
 #include <errno.h>
 using namespace std;
 
+/*
+ * A node whose tie breaker is regenerated from a seed has no tie breaker
+ * vector; KD_NO_TIE_SEED marks the nodes that keep an explicit one. On
+ * disk, KD_TIE_SEEDED flags the dimension of a node that is followed by
+ * its seed instead of the vector.
+ */
+#define KD_NO_TIE_SEED      ((uint64_t)-1)
+#define KD_TIE_SEEDED       ((size_t)1 << 63)
+
 /* Class Prototypes */
 
 template<class Label, class T>
@@ -27,26 +36,59 @@ class KDTree;
  * Description      : Data structure to hold a node of a KDTree
  * Data Field(s)    : index_        - The max variance index
  *                    pivot_        - The value of pivot
- *                    tie_breaker_  - The tie breaker vector
+ *                    tie_breaker_  - The tie breaker vector, empty if seeded
+ *                    tie_seed_     - The seed of the tie breaker, KD_NO_TIE_SEED
+ *                                    if it is kept as a vector
  *                    tie_pivot_    - The value of pivot of tie breaker
  *                    dimension_    - The dimension of feature, used in de-serialization
+ *                    spill_l_      - Lower end of the spill range of a virtual
+ *                                    spill tree
+ *                    spill_r_      - Upper end of the spill range of a virtual
+ *                                    spill tree
+ *                    sketch_       - Quantile sketch of the split coordinate,
+ *                                    empty unless a virtual spill tree picks
+ *                                    its spill factor at query time
  *                    left_         - Pointer to left subtree node
  *                    right_        - Pointer to right subtree node
  *                    domain_       - vectors out of vector space in data set
  * Functions(s)     : KDTreeNode(const vector<size_t>) 
  *                              - Create a KDTreeNode of given domain (leaf)
- *                    KDTreeNode(size_t, T, vector<size_t>)
+ *                    KDTreeNode(size_t, T, vector<size_t>, size_t, double, vector<double>)
  *                              - Create a KDTreeNode of given domain (non-leaf)
+ *                    KDTreeNode(size_t, T, vector<size_t>, size_t, double, uint64_t)
+ *                              - Create a KDTreeNode of given domain whose
+ *                                tie breaker is regenerated from a seed
  *                    KDTreeNode(ifstream &)
  *                              - Creates a KDTreeNode through de-serialization
  *                    size_t get_index() const
  *                              - Gets index of max variance
+ *                    double get_tie_pivot() const
+ *                              - Gets the pivot of the tie breaker
+ *                    vector<double> get_tie_breaker() const
+ *                              - Returns the tie breaker vector
+ *                    bool is_tie_seeded() const, uint64_t get_tie_seed() const
+ *                              - Whether the tie breaker comes from a seed,
+ *                                and the seed
+ *                    double tie_product(const vector<T> &) const
+ *                              - Returns the dot product of a vector with
+ *                                the tie breaker
  *                    KDTreeNode * get_left() const
  *                              - Returns pointer to left subtree node
  *                    KDTreeNode * get_right() const
  *                              - Returns pointer to right subtree node
  *                    vector<size_t> get_domain() const
  *                              - Returns the domain the node stores
+ *                    size_t get_domain_size() const
+ *                              - Returns the size of the domain without
+ *                                copying it
+ *                    T get_spill_l() const, T get_spill_r() const
+ *                              - Return the spill range
+ *                    void set_spill_range(T, T)
+ *                              - Sets the spill range
+ *                    const vector<T> & get_sketch() const
+ *                              - Returns the quantile sketch
+ *                    void set_sketch(const vector<T> &)
+ *                              - Sets the quantile sketch
  *                    void set_left(KDTreeNode *)
  *                              - Sets the left subtree node
  *                    void set_right(KDTreeNode *)
@@ -61,13 +103,17 @@ protected:
     size_t index_;
     T pivot_;
     vector<double> tie_breaker_;
+    uint64_t tie_seed_;
     double tie_pivot_;
     size_t dimension_;
+    T spill_l_, spill_r_;
+    vector<T> sketch_;
     KDTreeNode * left_, * right_;
     vector<size_t> domain_;
 public:
     KDTreeNode(const vector<size_t> domain);
     KDTreeNode(size_t index, T pivot, vector<size_t> domain, size_t dimension, double tie_pivot, vector<double> tie_breaker);
+    KDTreeNode(size_t index, T pivot, vector<size_t> domain, size_t dimension, double tie_pivot, uint64_t tie_seed);
     KDTreeNode(ifstream & in);
     ~KDTreeNode();
     size_t get_index() const
@@ -78,8 +124,30 @@ public:
     { return right_; }
     T get_pivot() const
     { return pivot_;}
+    double get_tie_pivot() const
+    { return tie_pivot_; }
+    vector<double> get_tie_breaker() const
+    { return is_tie_seeded() ? seeded_tie_breaker(tie_seed_, dimension_) : tie_breaker_; }
+    bool is_tie_seeded() const
+    { return tie_seed_ != KD_NO_TIE_SEED; }
+    uint64_t get_tie_seed() const
+    { return tie_seed_; }
+    double tie_product(const vector<T> & v) const
+    { return is_tie_seeded() ? seeded_dot(v, tie_seed_, dimension_) : dot(v, tie_breaker_); }
     vector<size_t> get_domain() const
     { return domain_; }
+    size_t get_domain_size() const
+    { return domain_.size(); }
+    T get_spill_l() const
+    { return spill_l_; }
+    T get_spill_r() const
+    { return spill_r_; }
+    void set_spill_range(T spill_l, T spill_r)
+    { spill_l_ = spill_l; spill_r_ = spill_r; }
+    const vector<T> & get_sketch() const
+    { return sketch_; }
+    void set_sketch(const vector<T> & sketch)
+    { sketch_ = sketch; }
     void set_left(KDTreeNode * left)
     { left_ = left; };
     void set_right(KDTreeNode * right)
@@ -120,8 +188,8 @@ private:
 protected:
     KDTreeNode<Label, T> * root_;
     DataSet<Label, T> & st_;
-    KDTree(DataSet<Label, T> & st);
 public:
+    KDTree(DataSet<Label, T> & st);
     KDTree(size_t min_leaf_size, DataSet<Label, T> & st);
     KDTree(ifstream & in, DataSet<Label, T> & st);
     ~KDTree();
@@ -179,7 +247,8 @@ KDTreeNode<Label, T> * KDTree<Label, T>::build_tree(size_t min_leaf_size,
     /*Distribute pivot pool to all the children nodes
     dot a random vector then do split again*/
     size_t dimension = (*subst[0]).size();
-    vector<double> tie_breaker = random_tie_breaker(dimension);
+    uint64_t tie_seed = random_tie_seed();
+    vector<double> tie_breaker = seeded_tie_breaker(tie_seed, dimension);
     
 	/*extract the vectors from dataset*/
     DataSet<Label, T> tie_vectors = st.subset(pivot_pool);
@@ -204,7 +273,7 @@ KDTreeNode<Label, T> * KDTree<Label, T>::build_tree(size_t min_leaf_size,
     }
     
     KDTreeNode<Label, T> * result = new KDTreeNode<Label, T>
-            (mx_var_index, pivot, domain, dimension, tie_pivot, tie_breaker);
+            (mx_var_index, pivot, domain, dimension, tie_pivot, tie_seed);
     result->left_ = build_tree(min_leaf_size, st, subdomain_l);
     result->right_ = build_tree(min_leaf_size, st, subdomain_r);
     LOG_FINE("> sdl = %ld\n", subdomain_l.size());
@@ -222,6 +291,9 @@ KDTreeNode<Label, T>::KDTreeNode(const vector<size_t> domain) :
   tie_pivot_(0),
   dimension_(0),
   tie_breaker_(NULL),
+  tie_seed_ (KD_NO_TIE_SEED),
+  spill_l_ (),
+  spill_r_ (),
   left_ (NULL),
   right_ (NULL),
   domain_ (domain)
@@ -238,7 +310,10 @@ KDTreeNode<Label, T>::KDTreeNode(size_t index,
   pivot_ (pivot),
   tie_pivot_(tie_pivot),
   tie_breaker_(tie_breaker),
+  tie_seed_ (KD_NO_TIE_SEED),
   dimension_ (dimension),
+  spill_l_ (),
+  spill_r_ (),
   left_ (NULL), 
   right_ (NULL),
   domain_ (domain)
@@ -249,7 +324,30 @@ KDTreeNode<Label, T>::KDTreeNode(size_t index,
 }
 
 template<class Label, class T>
-KDTreeNode<Label, T>::KDTreeNode(ifstream & in)
+KDTreeNode<Label, T>::KDTreeNode(size_t index,
+        T pivot, vector<size_t> domain, size_t dimension,
+        double tie_pivot, uint64_t tie_seed) :
+  index_ (index),
+  pivot_ (pivot),
+  tie_pivot_(tie_pivot),
+  tie_seed_ (tie_seed),
+  dimension_ (dimension),
+  spill_l_ (),
+  spill_r_ (),
+  left_ (NULL),
+  right_ (NULL),
+  domain_ (domain)
+{
+    LOG_FINE("KDTreeNode Constructed\n");
+    LOG_FINE("with index = %ld, domain.size = %ld, tie seed\n", index,
+            domain.size());
+}
+
+template<class Label, class T>
+KDTreeNode<Label, T>::KDTreeNode(ifstream & in) :
+  tie_seed_ (KD_NO_TIE_SEED),
+  spill_l_ (),
+  spill_r_ ()
 {
     LOG_FINE("KDTreeNode Constructed\n"); 
     LOG_FINE("with input stream\n");
@@ -257,7 +355,11 @@ KDTreeNode<Label, T>::KDTreeNode(ifstream & in)
     in.read((char *)&pivot_, sizeof(T));
     in.read((char *)&tie_pivot_, sizeof(double));
     in.read((char *)&dimension_, sizeof(size_t));
-    size_t dimen = dimension_;
+    if (dimension_ & KD_TIE_SEEDED) {
+        dimension_ &= ~KD_TIE_SEEDED;
+        in.read((char *)&tie_seed_, sizeof(uint64_t));
+    }
+    size_t dimen = is_tie_seeded() ? 0 : dimension_;
     LOG_FINE("> dimension = %ld\n", dimen);
     while (dimen--)
     {
@@ -298,12 +400,18 @@ void KDTreeNode<Label, T>::save(ofstream & out) const
     out.write((char *)&index_, sizeof(size_t)); 
     out.write((char *)&pivot_, sizeof(T));
     out.write((char *)&tie_pivot_,sizeof(double));
-    out.write((char *)&dimension_, sizeof(size_t));
-	if (tie_breaker_.empty()){
-		out.write((char *)&tie_breaker_, sizeof(double) * dimension_);
-	} else {
-		out.write((char *)&tie_breaker_[0], sizeof(double) * dimension_);
-	}
+    if (is_tie_seeded()) {
+        size_t flagged = dimension_ | KD_TIE_SEEDED;
+        out.write((char *)&flagged, sizeof(size_t));
+        out.write((char *)&tie_seed_, sizeof(uint64_t));
+    }
+    else {
+        out.write((char *)&dimension_, sizeof(size_t));
+        if (tie_breaker_.empty())
+            out.write((char *)&tie_breaker_, sizeof(double) * dimension_);
+        else
+            out.write((char *)&tie_breaker_[0], sizeof(double) * dimension_);
+    }
     size_t sz = domain_.size();
     out.write((char *)&sz, sizeof(size_t)); 
     out.write((char *)&domain_[0], 
@@ -396,7 +504,7 @@ vector<size_t> KDTree<Label, T>::subdomain(vector<T> * query, size_t l_c)
             else if ((*query)[cur->index_] > cur->pivot_)
                 expl.push(cur->right_);
             else {
-                double product = dot(*query, cur->tie_breaker_);
+                double product = cur->tie_product(*query);
                 if (product <= cur->tie_pivot_)
                     expl.push(cur->left_);
                 else
@@ -5,13 +5,19 @@
 #ifndef KD_VIRTUAL_SPILL_TREE_H_
 #define KD_VIRTUAL_SPILL_TREE_H_
 
-#include <map>
+#include <algorithm>
 #include <queue>
 #include <set>
 #include <utility>
 #include "kd_tree.h"
+#include "kd_skeleton.h"
 using namespace std;
 
+/* Number of quantiles kept per node to pick the spill factor at query time */
+#ifndef KD_SKETCH_SIZE
+#define KD_SKETCH_SIZE          (65)
+#endif
+
 /* Class Definitions */
 
 /* 
@@ -19,30 +25,58 @@ using namespace std;
  * Description      : Encapsulates the KDTreeNodes into a virtual spill tree.
  *                    Effectively acts as identically to KDTree with spillage
  *                    in terms of its query method.
- * Data Field(s)    : range_mp  - A map to match a node with its range
+ * Data Field(s)    : None
  * Functions(s)     : KDVirtualSpillTree(size_t, double, DataSet<Label, T> &)
  *                              - Creates a spill tree with given min leaf size
  *                                and the spill factor
+ *                    KDVirtualSpillTree(const KDSkeleton<Label, T> &, double, DataSet<Label, T> &)
+ *                              - Creates a spill tree from a copy of the
+ *                                skeleton's partition and its spill bands;
+ *                                the skeleton must hold the bands of a_value
  *                    KDVirtualSpillTree(ifStream & in, DataSet<Label, T> & st)
  *                              - De-serializes a virtual spill tree
+ *                    KDVirtualSpillTree(ifstream &, double, DataSet<Label, T> &, bool)
+ *                              - Creates a spill tree from a serialized
+ *                                KDTree and the spill factor, with the
+ *                                quantile sketch of every node if asked
+ *                    KDVirtualSpillTree(ifstream &, ifstream &, DataSet<Label, T> &)
+ *                              - Creates a spill tree from a serialized
+ *                                KDTree and its range side-car
  *                    void save(ofstream &) const 
  *                              - Serializes a virtual spill tree with its range
  *                                appended to the end
+ *                    bool save_ranges(const KDTree<Label, T> &, const double *, size_t, ofstream *)
+ *                              - Writes the range side-cars of a KDTree for
+ *                                several spill factors at once
  *                    vector<size_t> subdomain(vector<T> *, size_t)
  *                              - Queries the node with the spillage
+ *                    vector<size_t> subdomain(vector<T> *, size_t, size_t *, double)
+ *                              - Queries the node with the spillage of a
+ *                                spill factor picked from the sketches
  */
 template<class Label, class T>
 class KDVirtualSpillTree : public KDTree<Label, T>
 {
     typedef pair<T, T> range;
 protected:
-    map<KDTreeNode<Label, T> *, range> range_mp_;
     KDVirtualSpillTree(DataSet<Label, T> & st);
+    static void node_ranges(DataSet<Label, T> & st, const KDTreeNode<Label, T> * node,
+            const double * a_values, size_t a_count, range * ranges, vector<T> * sketch = NULL);
+    static T sketch_quantile(const vector<T> & sketch, size_t count, size_t k);
+    void set_ranges(double a_value, bool sketch = false);
 public:
     KDVirtualSpillTree(size_t min_leaf_size, double a_value, DataSet<Label, T> & st);
+    KDVirtualSpillTree(const KDSkeleton<Label, T> & skeleton, double a_value, DataSet<Label, T> & st);
     KDVirtualSpillTree(ifstream & in, DataSet<Label, T> & st);
+    KDVirtualSpillTree(ifstream & tree_in, double a_value, DataSet<Label, T> & st,
+            bool sketch = false);
+    KDVirtualSpillTree(ifstream & tree_in, ifstream & range_in, DataSet<Label, T> & st);
     virtual void save(ofstream & out) const;
+    static bool save_ranges(const KDTree<Label, T> & tree, const double * a_values,
+            size_t a_count, ofstream * outs);
     virtual vector<size_t> subdomain(vector<T> * query, size_t l_c = 0, size_t* l = 0);
+    vector<size_t> subdomain(vector<T> * query, size_t leaf_size, size_t * number_of_leaves,
+            double a_value);
 };
 
 /* Private Functions */
@@ -55,15 +89,70 @@ KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(DataSet<Label, T> & st) :
     LOG_FINE("with default constructor\n");
 }
 
-/* Public Functions */
+/*
+ * Computes the ranges of a node for several spill factors. The values at the
+ * split index are gathered and sorted once, so every factor's quantiles are
+ * read off the same pass over the node's domain. If sketch is given, it is
+ * set to KD_SKETCH_SIZE evenly ranked values, or all of them if fewer.
+ */
+template<class Label, class T>
+void KDVirtualSpillTree<Label, T>::node_ranges(DataSet<Label, T> & st,
+        const KDTreeNode<Label, T> * node, const double * a_values, size_t a_count,
+        range * ranges, vector<T> * sketch)
+{
+    vector<size_t> domain = node->get_domain();
+    size_t index = node->get_index();
+    vector<T> values (domain.size());
+    for (size_t i = 0; i < domain.size(); i++)
+        values[i] = (*st[domain[i]])[index];
+    sort(values.begin(), values.end());
+    for (size_t a = 0; a < a_count; a++) {
+        if (values.empty()) {
+            ranges[a] = range(T(), T());
+            continue;
+        }
+        /* The k-th smallest value, as selector finds it */
+        size_t k_l = (size_t)(values.size() * (0.5 - a_values[a]));
+        size_t k_r = (size_t)(values.size() * (0.5 + a_values[a]));
+        ranges[a] = range(values[k_l ? min(k_l, values.size()) - 1 : 0],
+                values[k_r ? min(k_r, values.size()) - 1 : 0]);
+    }
+    if (sketch) {
+        if (values.size() <= KD_SKETCH_SIZE) {
+            *sketch = values;
+            return;
+        }
+        sketch->resize(KD_SKETCH_SIZE);
+        for (size_t j = 0; j < KD_SKETCH_SIZE; j++)
+            (*sketch)[j] = values[(j * (values.size() - 1) + (KD_SKETCH_SIZE - 1) / 2)
+                / (KD_SKETCH_SIZE - 1)];
+    }
+}
 
+/*
+ * Approximates the k-th smallest of count values by the sketch entry of the
+ * nearest rank. The sketch of a node with at most KD_SKETCH_SIZE values holds
+ * them all, so the result is then exact.
+ */
 template<class Label, class T>
-KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(size_t min_leaf_size, double a_value,
-        DataSet<Label, T> & st) :
-  KDTree<Label, T>(min_leaf_size, st)
+T KDVirtualSpillTree<Label, T>::sketch_quantile(const vector<T> & sketch, size_t count, size_t k)
 {
-    LOG_INFO("KDVirtualSpillTree Constructed\n"); 
-    LOG_FINE("with min_leaf_size = %ld, alpha = %lf\n", min_leaf_size, a_value);
+    if (sketch.empty())
+        return T();
+    k = k ? min(k, count) - 1 : 0;
+    if (count <= 1)
+        return sketch[0];
+    return sketch[(k * (sketch.size() - 1) + (count - 1) / 2) / (count - 1)];
+}
+
+/*
+ * Sets the ranges of every node for a_value and, if asked, the sketches of
+ * the internal nodes, both off the one sort node_ranges does per node.
+ */
+template<class Label, class T>
+void KDVirtualSpillTree<Label, T>::set_ranges(double a_value, bool sketch)
+{
+    vector<T> node_sketch;
     queue<KDTreeNode<Label, T> *> to_update;
     to_update.push((this->get_root()));
     while (!to_update.empty())
@@ -73,22 +162,70 @@ KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(size_t min_leaf_size, double a_
         bool exists = cur != NULL;
         if (exists)
         {
-            DataSet<Label, T> subst = st.subset(cur->get_domain());
-            size_t mx_var_index = cur->get_index();
-            vector<T> values;
-            for (size_t i = 0; i < subst.size(); i++)
-            {
-                values.push_back((*subst[i])[mx_var_index]);
-            }
-            double pivot_l = selector(values, (size_t)(values.size() * (0.5 - a_value)));
-            double pivot_r = selector(values, (size_t)(values.size() * (0.5 + a_value)));
-            range_mp_[cur] = range(pivot_l, pivot_r);
+            range cur_range;
+            bool internal = cur->get_left() && cur->get_right();
+            node_ranges(this->get_st(), cur, &a_value, 1, &cur_range,
+                    sketch && internal ? &node_sketch : NULL);
+            cur->set_spill_range(cur_range.first, cur_range.second);
+            if (sketch && internal)
+                cur->set_sketch(node_sketch);
             to_update.push(cur->get_left());
             to_update.push(cur->get_right());
         }
     }
 }
 
+/* Public Functions */
+
+template<class Label, class T>
+KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(size_t min_leaf_size, double a_value,
+        DataSet<Label, T> & st) :
+  KDTree<Label, T>(min_leaf_size, st)
+{
+    LOG_INFO("KDVirtualSpillTree Constructed\n"); 
+    LOG_FINE("with min_leaf_size = %ld, alpha = %lf\n", min_leaf_size, a_value);
+    set_ranges(a_value);
+}
+
+template<class Label, class T>
+KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(const KDSkeleton<Label, T> & skeleton,
+        double a_value, DataSet<Label, T> & st) :
+  KDTree<Label, T>(st)
+{
+    LOG_INFO("KDVirtualSpillTree Constructed\n");
+    LOG_FINE("with skeleton, alpha = %lf\n", a_value);
+    const KDTreeNode<Label, T> * skel_root = skeleton.get_tree().get_root();
+    if (!skel_root)
+        return;
+    KDTreeNode<Label, T> * root = new KDTreeNode<Label, T>(*skel_root);
+    this->set_root(root);
+    queue<pair<KDTreeNode<Label, T> *, const KDTreeNode<Label, T> *> > to_update;
+    to_update.push(make_pair(root, skel_root));
+    while (!to_update.empty())
+    {
+        KDTreeNode<Label, T> * cur = to_update.front().first;
+        const KDTreeNode<Label, T> * skel = to_update.front().second;
+        to_update.pop();
+        KDTreeNode<Label, T> * left = skel->get_left() ?
+            new KDTreeNode<Label, T>(*skel->get_left()) : NULL;
+        KDTreeNode<Label, T> * right = skel->get_right() ?
+            new KDTreeNode<Label, T>(*skel->get_right()) : NULL;
+        cur->set_left(left);
+        cur->set_right(right);
+        if (left && right)
+        {
+            const KDSplitRange<T> & band = skeleton.get_range(a_value, skel);
+            cur->set_spill_range(band.lo, band.hi);
+        }
+        else
+            cur->set_spill_range(T(), T());
+        if (left)
+            to_update.push(make_pair(left, skel->get_left()));
+        if (right)
+            to_update.push(make_pair(right, skel->get_right()));
+    }
+}
+
 template<class Label, class T>
 KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(ifstream & in, 
         DataSet<Label, T> & st) :
@@ -108,13 +245,95 @@ KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(ifstream & in,
             T pivot_l, pivot_r;
             in.read((char *)&pivot_l, sizeof(T));
             in.read((char *)&pivot_r, sizeof(T));
-            range_mp_[cur] = range(pivot_l, pivot_r);
+            cur->set_spill_range(pivot_l, pivot_r);
             to_update.push(cur->get_left());
             to_update.push(cur->get_right());
         }
     }
 }
 
+template<class Label, class T>
+KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(ifstream & tree_in, double a_value,
+        DataSet<Label, T> & st, bool sketch) :
+  KDTree<Label, T>(tree_in, st)
+{
+    LOG_INFO("KDVirtualSpillTree Constructed\n");
+    LOG_FINE("with kd tree stream, alpha = %lf, sketch = %d\n", a_value, (int)sketch);
+    set_ranges(a_value, sketch);
+}
+
+/*
+ * A range side-car holds the number of nodes of the KDTree followed by the
+ * ranges of its nodes in breadth first order, as save() appends them.
+ */
+template<class Label, class T>
+KDVirtualSpillTree<Label, T>::KDVirtualSpillTree(ifstream & tree_in, ifstream & range_in,
+        DataSet<Label, T> & st) :
+  KDTree<Label, T>(tree_in, st)
+{
+    LOG_INFO("KDVirtualSpillTree Constructed\n");
+    LOG_FINE("with kd tree and range streams\n");
+    size_t node_count = 0, tree_node_count = 0;
+    range_in.read((char *)&node_count, sizeof(size_t));
+    queue<KDTreeNode<Label, T> *> to_update;
+    to_update.push((this->get_root()));
+    while (!to_update.empty())
+    {
+        KDTreeNode<Label, T> * cur = to_update.front();
+        to_update.pop();
+        bool exists = cur != NULL;
+        if (exists)
+        {
+            T pivot_l = T(), pivot_r = T();
+            range_in.read((char *)&pivot_l, sizeof(T));
+            range_in.read((char *)&pivot_r, sizeof(T));
+            cur->set_spill_range(pivot_l, pivot_r);
+            tree_node_count++;
+            to_update.push(cur->get_left());
+            to_update.push(cur->get_right());
+        }
+    }
+    if (!range_in || node_count != tree_node_count)
+        LOG_ERROR("Range side-car holds %ld nodes, kd tree has %ld\n",
+                node_count, tree_node_count);
+}
+
+template<class Label, class T>
+bool KDVirtualSpillTree<Label, T>::save_ranges(const KDTree<Label, T> & tree,
+        const double * a_values, size_t a_count, ofstream * outs)
+{
+    LOG_INFO("Saving ranges of %ld spill factors\n", a_count);
+    vector<const KDTreeNode<Label, T> *> nodes;
+    queue<const KDTreeNode<Label, T> *> to_save;
+    to_save.push(tree.get_root());
+    while (!to_save.empty())
+    {
+        const KDTreeNode<Label, T> * cur = to_save.front();
+        to_save.pop();
+        if (cur)
+        {
+            nodes.push_back(cur);
+            to_save.push(cur->get_left());
+            to_save.push(cur->get_right());
+        }
+    }
+    size_t node_count = nodes.size();
+    for (size_t a = 0; a < a_count; a++)
+        outs[a].write((char *)&node_count, sizeof(size_t));
+    vector<range> ranges (a_count);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        node_ranges(tree.get_st(), nodes[i], a_values, a_count, ranges.data());
+        for (size_t a = 0; a < a_count; a++) {
+            outs[a].write((char *)&ranges[a].first, sizeof(T));
+            outs[a].write((char *)&ranges[a].second, sizeof(T));
+        }
+    }
+    bool good = true;
+    for (size_t a = 0; a < a_count; a++)
+        good = good && outs[a].good();
+    return good;
+}
+
 template<class Label, class T>
 void KDVirtualSpillTree<Label, T>::save(ofstream & out) const
 {
@@ -129,9 +348,9 @@ void KDVirtualSpillTree<Label, T>::save(ofstream & out) const
         bool exists = cur != NULL;
         if (exists)
         {
-            range cur_range = range_mp_.at(cur);
-            out.write((char *)&cur_range.first, sizeof(T));
-            out.write((char *)&cur_range.second, sizeof(T));
+            T pivot_l = cur->get_spill_l(), pivot_r = cur->get_spill_r();
+            out.write((char *)&pivot_l, sizeof(T));
+            out.write((char *)&pivot_r, sizeof(T));
             to_save.push(cur->get_left());
             to_save.push(cur->get_right());
         }
@@ -140,9 +359,22 @@ void KDVirtualSpillTree<Label, T>::save(ofstream & out) const
 
 template<class Label, class T>
 vector<size_t> KDVirtualSpillTree<Label, T>::subdomain(vector<T> * query, size_t leaf_size, size_t * number_of_leaves)
+{
+    return subdomain(query, leaf_size, number_of_leaves, -1);
+}
+
+/*
+ * With a negative a_value the ranges set at build time are used, otherwise
+ * each node's range is read off its sketch, which the tree must have been
+ * loaded with. The tree is not modified, so queries of different spill factors
+ * may run concurrently.
+ */
+template<class Label, class T>
+vector<size_t> KDVirtualSpillTree<Label, T>::subdomain(vector<T> * query, size_t leaf_size,
+        size_t * number_of_leaves, double a_value)
 {
     LOG_INFO("Enter subdomain\n");
-    LOG_FINE("with leaf_size = %ld\n", leaf_size);
+    LOG_FINE("with leaf_size = %ld, alpha = %lf\n", leaf_size, a_value);
     queue<KDTreeNode<Label, T> *> to_explore;
     set<size_t> domain_st;
     to_explore.push(this->get_root());
@@ -155,17 +387,24 @@ vector<size_t> KDVirtualSpillTree<Label, T>::subdomain(vector<T> * query, size_t
         if (exists)
         {
             //size_t tmp_sum = domain_sum + cur->get_domain().size();
+            size_t count = cur->get_domain_size();
             if ((cur->get_left() || cur->get_right()) &&
-                cur->get_domain().size() >= leaf_size)
+                count >= leaf_size)
             {
-                range cur_range = range_mp_.at(cur);
-                if (cur_range.first <= (*query)[cur->get_index()] &&
-                        (*query)[cur->get_index()] < cur_range.second)
+                T value = (*query)[cur->get_index()];
+                T spill_l = cur->get_spill_l(), spill_r = cur->get_spill_r();
+                if (a_value >= 0)
+                {
+                    const vector<T> & sketch = cur->get_sketch();
+                    spill_l = sketch_quantile(sketch, count, (size_t)(count * (0.5 - a_value)));
+                    spill_r = sketch_quantile(sketch, count, (size_t)(count * (0.5 + a_value)));
+                }
+                if (spill_l <= value && value < spill_r)
                 {
                     to_explore.push(cur->get_right());
                     to_explore.push(cur->get_left());
                 }
-                else if ((*query)[cur->get_index()] <= cur->get_pivot())
+                else if (value <= cur->get_pivot())
                     to_explore.push(cur->get_left());
                 else
                     to_explore.push(cur->get_right());
@@ -175,10 +414,7 @@ vector<size_t> KDVirtualSpillTree<Label, T>::subdomain(vector<T> * query, size_t
                 //domain_sum += cur->get_domain().size();
                 (*number_of_leaves)++;
                 vector<size_t> l_domain = cur->get_domain();
-                for (size_t i = 0; i < l_domain.size(); i++)
-                {
-                    domain_st.insert(l_domain[i]);
-                }
+                domain_st.insert(l_domain.begin(), l_domain.end());
             }
         }
     }
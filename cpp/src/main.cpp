@@ -8,111 +8,259 @@ using namespace std;
 
 typedef unsigned char byte;
 
+/*
+ * Runs the test of one tree on a data set stored with elements of type T.
+ * Returns false if the tree name is unknown.
+ */
+template<class T>
+bool run_tree(const string & set_DIR, const string & tree)
+{
+	/* For approximate NN search */
+	//Test<byte,T> mTest(DIR + set_DIR, 1.4);
+
+	/* For exact NN search */
+	Test<byte, T> mTest(set_DIR);
+
+	if (tree == "kd") {
+		mTest.generate_kd_trees();
+		mTest.generate_kd_tree_data(set_DIR);
+	}
+	else if (tree == "pca_kd") {
+		mTest.generate_rotated_kd_trees(false);
+		mTest.generate_rotated_kd_tree_data(set_DIR, false);
+	}
+	else if (tree == "hadamard_kd") {
+		mTest.generate_rotated_kd_trees(true);
+		mTest.generate_rotated_kd_tree_data(set_DIR, true);
+	}
+	else if (tree == "rkd") {
+		mTest.generate_rkd_trees();
+		mTest.generate_rkd_tree_data(set_DIR);
+	}
+	else if (tree == "rp") {
+		mTest.generate_rp_trees();
+		mTest.generate_rp_tree_data(set_DIR);
+	}
+	else if (tree == "rp_2means") {
+		mTest.generate_rp_trees(false, SPLIT_TWO_MEANS);
+		mTest.generate_rp_tree_data(set_DIR, false, SPLIT_TWO_MEANS);
+	}
+	else if (tree == "v2_2means") {
+		mTest.generate_v2_trees(SPLIT_TWO_MEANS);
+		mTest.generate_v2_tree_data(set_DIR, SPLIT_TWO_MEANS);
+	}
+	else if (tree == "pca_2means") {
+		mTest.generate_pca_trees(SPLIT_TWO_MEANS);
+		mTest.generate_pca_tree_data(set_DIR, SPLIT_TWO_MEANS);
+	}
+	else if (tree == "sparse_rp") {
+		mTest.generate_rp_trees(true);
+		mTest.generate_rp_tree_data(set_DIR, true);
+	}
+	else if (tree == "v2") {
+		mTest.generate_v2_trees();
+		mTest.generate_v2_tree_data(set_DIR);
+	}
+	else if (tree == "rkd_latency") {
+		mTest.generate_rkd_trees();
+		mTest.generate_forest_latency_data(set_DIR, "rkd");
+	}
+	else if (tree == "rp_latency") {
+		mTest.generate_rp_trees();
+		mTest.generate_forest_latency_data(set_DIR, "rp");
+	}
+	else if (tree == "rkd_vote") {
+		mTest.generate_rkd_trees();
+		mTest.generate_forest_vote_data(set_DIR, "rkd");
+	}
+	else if (tree == "rp_vote") {
+		mTest.generate_rp_trees();
+		mTest.generate_forest_vote_data(set_DIR, "rp");
+	}
+	else if (tree == "rp_probe") {
+		mTest.generate_rp_trees();
+		mTest.generate_forest_probe_data(set_DIR, "rp");
+	}
+	else if (tree == "v2_probe") {
+		mTest.generate_v2_trees();
+		mTest.generate_forest_probe_data(set_DIR, "v2");
+	}
+	else if (tree == "rp_forest") {
+		mTest.generate_rp_forest();
+		mTest.generate_rp_forest_data(set_DIR);
+	}
+	else if (tree == "v2_forest") {
+		mTest.generate_rp_forest(true);
+		mTest.generate_rp_forest_data(set_DIR, true);
+	}
+	else if (tree == "pca") {
+		mTest.generate_pca_trees();
+		mTest.generate_pca_tree_data(set_DIR);
+	}
+	else if (tree == "pca_spill") {
+		mTest.generate_pca_spill_trees();
+		mTest.generate_pca_spill_tree_data(set_DIR);
+	}
+	else if (tree == "kd_spill") {
+		mTest.generate_kd_spill_trees();
+		mTest.generate_kd_spill_tree_data(set_DIR);
+	}
+	else if (tree == "pca_n_spill" || tree == "rp_n_spill") {
+		bool random_dir = tree == "rp_n_spill";
+		mTest.generate_pn_spill_trees(random_dir);
+		mTest.generate_pn_spill_tree_data(set_DIR, random_dir);
+	}
+	else if (tree == "pca_spill_budget") {
+		mTest.generate_pca_spill_trees(true);
+		mTest.generate_pca_spill_tree_data(set_DIR, true);
+	}
+	else if (tree == "kd_spill_budget") {
+		mTest.generate_kd_spill_trees(true);
+		mTest.generate_kd_spill_tree_data(set_DIR, true);
+	}
+	else if (tree == "kd_v_spill") {
+		mTest.generate_kd_v_spill_trees();
+		mTest.generate_kd_v_spill_tree_data(set_DIR);
+	}
+	else if (tree == "kd_v_ranges") {
+		mTest.generate_kd_trees();
+		mTest.generate_kd_v_spill_ranges();
+		mTest.generate_kd_v_spill_tree_data(set_DIR, true);
+	}
+	else if (tree == "kd_v_sketch") {
+		mTest.generate_kd_trees();
+		mTest.generate_kd_v_sketch_tree_data(set_DIR);
+	}
+	else if (tree == "pca_v_spill") {
+		mTest.generate_pca_trees();
+		mTest.generate_bsp_v_spill_tree_data(set_DIR, "pca");
+	}
+	else if (tree == "rp_v_spill") {
+		mTest.generate_rp_trees();
+		mTest.generate_bsp_v_spill_tree_data(set_DIR, "rp");
+	}
+	else if (tree == "v2_v_spill") {
+		mTest.generate_v2_trees();
+		mTest.generate_bsp_v_spill_tree_data(set_DIR, "v2");
+	}
+	else if (tree == "difficulty") {
+		mTest.difficulty(set_DIR);
+	}
+	else if (tree == "flatten") {
+		mTest.flatten_trees();
+	}
+	else
+		return false;
+	return true;
+}
+
+/* Runs the tests of all trees on a data set stored with elements of type T. */
+template<class T>
+void run_trees(const string & set_DIR)
+{
+	/* For approximate NN search */
+	//Test<byte,T> mTest(DIR + set_DIR, 1.4);
+
+	/* For exact NN search */
+	Test<byte, T> mTest(set_DIR);
+
+	mTest.generate_kd_trees();
+	mTest.generate_kd_tree_data(set_DIR);
+
+	mTest.generate_rkd_trees();
+	mTest.generate_rkd_tree_data(set_DIR);
+
+	mTest.generate_rp_trees();
+	mTest.generate_rp_tree_data(set_DIR);
+
+	mTest.generate_v2_trees();
+	mTest.generate_v2_tree_data(set_DIR);
+
+	mTest.generate_pca_trees();
+	mTest.generate_pca_tree_data(set_DIR);
+
+	mTest.generate_pca_spill_trees();
+	mTest.generate_pca_spill_tree_data(set_DIR);
+
+	mTest.generate_kd_spill_trees();
+	mTest.generate_kd_spill_tree_data(set_DIR);
+
+	/*mTest.generate_kd_v_spill_trees();
+	mTest.generate_kd_v_spill_tree_data(set_DIR);*/
+}
+
+/*
+ * Returns the element type of the training and test vectors of a data set,
+ * DATA_TYPE_NONE if they can't be read or differ.
+ */
+static size_t set_data_type(const string & set_DIR)
+{
+	size_t type = read_data_type(set_DIR + "/trn_vtr");
+	if (type != read_data_type(set_DIR + "/tst_vtr"))
+		return DATA_TYPE_NONE;
+	return type;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 2 && argc != 3 && argc != 6) {
+    if (argc < 2 || argc > 7 || argc == 4) {
         cerr << "Usage: " << endl;
-        cerr << "   1. Convert Data "<< argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) convert train_size test_size width" << endl;
+        cerr << "   1. Convert Data "<< argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) convert train_size test_size width [uint8]" << endl;
         cerr << "   2. Run Trees " << argv[0] << " DataName(mnist, cifar, songs, big5, w2v, sift)" << endl;
-        cerr << "   3. Run Specific Tree " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) tree_name(kd/rkd/rp/v2/pca/pca_spill/kd_spill/kd_v_spill/diff)" << endl;
+        cerr << "   3. Run Specific Tree " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) tree_name(kd/pca_kd/hadamard_kd/rkd/rp/sparse_rp/rp_2means/v2/v2_2means/rp_forest/v2_forest/rkd_latency/rp_latency/rkd_vote/rp_vote/rp_probe/v2_probe/pca/pca_2means/pca_spill/kd_spill/pca_n_spill/rp_n_spill/pca_spill_budget/kd_spill_budget/kd_v_spill/kd_v_ranges/kd_v_sketch/pca_v_spill/rp_v_spill/v2_v_spill/diff/flatten)" << endl;
+        cerr << "   4. Convert vecs " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) vecs base.(f/b/i)vecs query.(f/b/i)vecs [groundtruth.ivecs]" << endl;
 	} else {
 		string set_DIR = argv[1];
-		if (argc == 6) {
+		if ((argc == 5 || argc == 6) && string(argv[2]) == "vecs") {
+			cout << "Start to convert vecs data " << set_DIR << endl;
+			vecs_generate(set_DIR, argv[3], argv[4], argc == 6 ? argv[5] : "");
+		}
+		else if (argc == 6 || (argc == 7 && string(argv[6]) == "uint8")) {
 			size_t train_size = atoi(argv[3]);
 			size_t test_size = atoi(argv[4]);
 			size_t width = atoi(argv[5]);
 			cout << "Start to convert data " << set_DIR << endl;
-			data_generate(set_DIR, train_size, test_size, width);
+			data_generate(set_DIR, train_size, test_size, width, argc == 7);
 		}
 		else if (argc == 3) {
 			string tree = argv[2];
 			cout << "Start to build " << tree << endl;
-			/* For approximate NN search */
-			//Test<byte,float> mTest(DIR + set_DIR, 1.4);
-
-			/* For exact NN search */
-			Test<byte, float> mTest(set_DIR);
-
-			if (tree == "kd") {
-				mTest.generate_kd_trees();
-				mTest.generate_kd_tree_data(set_DIR);
+			size_t type = set_data_type(set_DIR);
+			if (type == DATA_TYPE_NONE) {
+				cerr << "Can't read " << set_DIR << ", or its trn_vtr and tst_vtr differ in element type." << endl;
+				return 1;
 			}
-			else if (tree == "rkd") {
-				mTest.generate_rkd_trees();
-				mTest.generate_rkd_tree_data(set_DIR);
-			}
-			else if (tree == "rp") {
-				mTest.generate_rp_trees();
-				mTest.generate_rp_tree_data(set_DIR);
-			}
-			else if (tree == "v2") {
-				mTest.generate_v2_trees();
-				mTest.generate_v2_tree_data(set_DIR);
-			}
-			else if (tree == "pca") {
-				mTest.generate_pca_trees();
-				mTest.generate_pca_tree_data(set_DIR);
-			}
-			else if (tree == "pca_spill") {
-				mTest.generate_pca_spill_trees();
-				mTest.generate_pca_spill_tree_data(set_DIR);
-			}
-			else if (tree == "kd_spill") {
-				mTest.generate_kd_spill_trees();
-				mTest.generate_kd_spill_tree_data(set_DIR);
-			}
-			else if (tree == "kd_v_spill") {
-				mTest.generate_kd_v_spill_trees();
-				mTest.generate_kd_v_spill_tree_data(set_DIR);
-			}
-            else if (tree == "difficulty") {
-                mTest.difficulty(set_DIR);
-            }
-			else {
+			bool known;
+			if (type == DATA_TYPE_UINT8)
+				known = run_tree<uint8_t>(set_DIR, tree);
+			else
+				known = run_tree<float>(set_DIR, tree);
+			if (!known) {
 				cerr << "Wrong Tree Name!" << endl;
 				cerr << "Usage: " << endl;
-				cerr << "   1. Convert Data " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) convert train_size test_size width" << endl;
+				cerr << "   1. Convert Data " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) convert train_size test_size width [uint8]" << endl;
 				cerr << "   2. Run Trees " << argv[0] << " DataName(mnist, cifar, songs, big5, w2v, sift)" << endl;
-				cerr << "   3. Run Specific Tree " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) tree_name(kd/rkd/rp/pca/pca_spill/kd_spill/kd_v_spill/diff)" << endl;
+				cerr << "   3. Run Specific Tree " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) tree_name(kd/pca_kd/hadamard_kd/rkd/rp/sparse_rp/rp_2means/v2/v2_2means/rp_forest/v2_forest/rkd_latency/rp_latency/rkd_vote/rp_vote/rp_probe/v2_probe/pca/pca_2means/pca_spill/kd_spill/pca_n_spill/rp_n_spill/pca_spill_budget/kd_spill_budget/kd_v_spill/kd_v_ranges/kd_v_sketch/pca_v_spill/rp_v_spill/v2_v_spill/diff/flatten)" << endl;
+				cerr << "   4. Convert vecs " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) vecs base.(f/b/i)vecs query.(f/b/i)vecs [groundtruth.ivecs]" << endl;
 			}
-
 		}
 		else if (argc == 2) {
-			/* For approximate NN search */
-			//Test<byte,float> mTest(DIR + set_DIR, 1.4);
-
-			/* For exact NN search */
-			Test<byte, float> mTest(set_DIR);
-
-			mTest.generate_kd_trees();
-			mTest.generate_kd_tree_data(set_DIR);
-
-			mTest.generate_rkd_trees();
-			mTest.generate_rkd_tree_data(set_DIR);
-
-			mTest.generate_rp_trees();
-			mTest.generate_rp_tree_data(set_DIR);
-
-			mTest.generate_v2_trees();
-			mTest.generate_v2_tree_data(set_DIR);
-
-			mTest.generate_pca_trees();
-			mTest.generate_pca_tree_data(set_DIR);
-
-			mTest.generate_pca_spill_trees();
-			mTest.generate_pca_spill_tree_data(set_DIR);
-
-			mTest.generate_kd_spill_trees();
-			mTest.generate_kd_spill_tree_data(set_DIR);
-
-			/*mTest.generate_kd_v_spill_trees();
-			mTest.generate_kd_v_spill_tree_data(set_DIR);*/
+			size_t type = set_data_type(set_DIR);
+			if (type == DATA_TYPE_NONE) {
+				cerr << "Can't read " << set_DIR << ", or its trn_vtr and tst_vtr differ in element type." << endl;
+				return 1;
+			}
+			if (type == DATA_TYPE_UINT8)
+				run_trees<uint8_t>(set_DIR);
+			else
+				run_trees<float>(set_DIR);
 		}
 		else {
 			cerr << "Usage: " << endl;
-			cerr << "   1. Convert Data " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) convert train_size test_size width" << endl;
+			cerr << "   1. Convert Data " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) convert train_size test_size width [uint8]" << endl;
 			cerr << "   2. Run Trees " << argv[0] << " DataName(mnist, cifar, songs, big5, w2v, sift)" << endl;
-			cerr << "   3. Run Specific Tree " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) tree_name(kd/rkd/rp/pca/pca_spill/kd_spill/kd_v_spill/diff)" << endl;
+			cerr << "   3. Run Specific Tree " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) tree_name(kd/pca_kd/hadamard_kd/rkd/rp/sparse_rp/rp_2means/v2/v2_2means/rp_forest/v2_forest/rkd_latency/rp_latency/rkd_vote/rp_vote/rp_probe/v2_probe/pca/pca_2means/pca_spill/kd_spill/pca_n_spill/rp_n_spill/pca_spill_budget/kd_spill_budget/kd_v_spill/kd_v_ranges/kd_v_sketch/pca_v_spill/rp_v_spill/v2_v_spill/diff/flatten)" << endl;
+			cerr << "   4. Convert vecs " << argv[0] << " DataName(mnist/cifar/songs/big5/w2v/sift) vecs base.(f/b/i)vecs query.(f/b/i)vecs [groundtruth.ivecs]" << endl;
 		}
 	}
 	cout << "Type any key to terminate." << endl;
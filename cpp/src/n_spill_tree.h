@@ -30,11 +30,9 @@ class NSpillTree;
  * Data Field(s)    : index_            - The max variance index
  *                    splits_           - The number of splits 'n'
  *                    dimension_        - The dimension of feature, used in de-serialization
- *                    left_pivots_      - vector of n left pivots
- *                    right_pivots_     - vector of n right pivots
+ *                    pivots_           - sorted n-1 pivots, cache-line aligned
  *                    tie_breaker_      - tie breaker vector
- *                    tie_left_pivots_  - vector of n left pivots in tie breaker
- *                    tie_right_pivots_ - vector of n right pivots in tie breaker
+ *                    tie_pivots_       - n-1 pivots in tie breaker
  *                    children_ - vector of n+1 subtree nodes
  *                    domain_   - vectors out of vector space in data set
  * Functions(s)     : NSpillTreeNode(const vector<size_t>)
@@ -57,7 +55,7 @@ protected:
     size_t index_;
     size_t splits_;
     size_t dimension_;
-    vector<T> pivots_;
+    vector<T, aligned_allocator<T> > pivots_;
     vector<double> tie_breaker_;
     vector<double> tie_pivots_;
     vector<NSpillTreeNode *> children_;
@@ -88,6 +86,10 @@ public:
  *                    NSpillTree(size_t, double, DataSet<Label, T>)
  *                          - Creates a tree of given min leaf size
  *                            and the spill factor
+ *                    NSpillTree(size_t, size_t, double, double, DataSet<Label, T>)
+ *                          - Creates a tree whose spill factor, at most
+ *                            the given one, adapts per node to keep the
+ *                            space blowup within a budget
  *                    NSpillTree(ifstream &, DataSet<Label, T>)
  *                          - De-serialization 
  *                    ~NSpillTree()
@@ -106,13 +108,16 @@ class NSpillTree
 {
 private:
     static NSpillTreeNode<Label, T> * build_tree(size_t leaf_size,
-            DataSet<Label, T> & st, size_t splits, double spill_factor, vector<size_t> domain);
+            DataSet<Label, T> & st, size_t splits, double spill_factor, vector<size_t> domain,
+            double budget = 0);
 protected:
     NSpillTreeNode<Label, T> * root_;
     DataSet<Label, T> & st_;
     NSpillTree(DataSet<Label, T> & st);
 public:
     NSpillTree(size_t leaf_size, size_t splits, double spill_factor, DataSet<Label, T> & st);
+    NSpillTree(size_t leaf_size, size_t splits, double spill_factor, double max_blowup,
+            DataSet<Label, T> & st);
     NSpillTree(ifstream & in, size_t splits, DataSet<Label, T> & st);
     ~NSpillTree();
     NSpillTreeNode<Label, T> * get_root() const
@@ -133,11 +138,14 @@ public:
 /*
  * Build tree of given mininum leaf size <min_leaf_size>,
  * dataset <st>, number of splits <splits>,
- * spill factor <spill_factor>, and vector space <domain>
+ * spill factor <spill_factor>, and vector space <domain>.
+ * With a positive <budget> the spill factor of each node is chosen to keep
+ * the space blowup of its subtree within the budget.
  */
 template<class Label, class T>
 NSpillTreeNode<Label, T> * NSpillTree<Label, T>::build_tree(size_t leaf_size,
-        DataSet<Label, T> & st, size_t splits, double spill_factor, vector<size_t> domain)
+        DataSet<Label, T> & st, size_t splits, double spill_factor, vector<size_t> domain,
+        double budget)
 {
     LOG_INFO("Enter build_tree\n");
     LOG_FINE("with min_leaf_size = %ld, splits = %ld, and domain size = %ld\n", leaf_size, splits, domain.size());
@@ -160,7 +168,12 @@ NSpillTreeNode<Label, T> * NSpillTree<Label, T>::build_tree(size_t leaf_size,
     //create and calculate the split pivots
     vector<T> left_pivots, right_pivots, pivots;
     size_t full_child_size = (size_t)(values.size()/splits);
-    size_t half_spill_size = (size_t)(values.size() * spill_factor);
+    double a_value = spill_factor;
+    if (budget > 0)
+        a_value = budget_spill_factor(values, spill_factor, budget, leaf_size, splits);
+    size_t half_spill_size = (size_t)(values.size() * a_value);
+    if (budget > 0)
+        half_spill_size = max(half_spill_size, (size_t)1); // the pools below need a spill band
     size_t end_child_size_lim = full_child_size - half_spill_size;
     size_t mid_child_size_lim = full_child_size - half_spill_size * 2;
     size_t spill_size_lim = half_spill_size * 2;
@@ -546,8 +559,15 @@ NSpillTreeNode<Label, T> * NSpillTree<Label, T>::build_tree(size_t leaf_size,
     
     //call build tree recursively to build tree
     vector<NSpillTreeNode<Label, T> *> children_vector;
+    double child_budget = 0;
+    if (budget > 0) {
+        size_t stored = 0;
+        for (int i=0; i<splits; i++)
+            stored += children[i].size();
+        child_budget = budget * domain.size() / stored;
+    }
     for (int i=0; i<splits; i++) {
-        NSpillTreeNode<Label, T> * node = build_tree(leaf_size, st, splits, spill_factor, children[i]);
+        NSpillTreeNode<Label, T> * node = build_tree(leaf_size, st, splits, spill_factor, children[i], child_budget);
         children_vector.push_back(node);
     }
     //return newly built tree
@@ -567,7 +587,7 @@ NSpillTreeNode<Label, T>::NSpillTreeNode(const vector<size_t> domain) :
   index_ (0),
   splits_(0),
   dimension_ (0),
-  pivots_ (NULL),
+  pivots_ (),
   tie_breaker_(NULL),
   tie_pivots_(NULL),
   children_ (NULL),
@@ -590,7 +610,7 @@ NSpillTreeNode<Label, T>::NSpillTreeNode(
   index_ (index),
   splits_ (splits),
   dimension_ (dimension),
-  pivots_ (pivots),
+  pivots_ (pivots.begin(), pivots.end()),
   tie_breaker_ (tie_breaker),
   tie_pivots_ (tie_pivots),
   children_ (children),
@@ -691,6 +711,17 @@ NSpillTree<Label, T>::NSpillTree(size_t leaf_size, size_t splits, double spill_f
     LOG_FINE("with leaf_size = %ld, spill_factor = %lf\n", leaf_size, spill_factor);
 }
 
+template<class Label, class T>
+NSpillTree<Label, T>::NSpillTree(size_t leaf_size, size_t splits, double spill_factor,
+        double max_blowup, DataSet<Label, T> & st) :
+  root_ (build_tree(leaf_size, st, splits, spill_factor, st.get_domain(), max_blowup)),
+  st_ (st)
+{
+    LOG_INFO("NSpillTree Constructed\n");
+    LOG_FINE("with leaf_size = %ld, spill_factor = %lf, max_blowup = %lf\n",
+            leaf_size, spill_factor, max_blowup);
+}
+
 template<class Label, class T>
 NSpillTree<Label, T>::~NSpillTree()
 {
@@ -765,31 +796,19 @@ vector<size_t> NSpillTree<Label, T>::subdomain(vector<T> * query, size_t l_c)
         expl.pop();
         if (!cur->children_.empty() &&
             cur->domain_.size() >= l_c) {
-            size_t splits = cur->splits_;
-            bool pushed = false;
-            for (int i = 0; i < splits-1; i++) {
-                size_t value = (*query)[cur->index_];
-                if (value < cur->pivots_[i]) {
-                    expl.push(cur->children_[i]);
-                    pushed = true;
-                    break;
-                }
-                else if (value == cur->pivots_[i]) {
-                    vector<double> tie_breaker = cur->tie_breaker_;
-                    double product = dot(*query, tie_breaker);
-                    //Can use tie_left_pivot when search
-                    //It doesn't matters where it goes when the tie range is smaller than the spill range, apply left tie won't hurt.
-                    //If tie range is larger than the spill range, left tie alone can determine which leaf to go.
-                    if (product <= cur->tie_pivots_[i]) {
-                        expl.push(cur->children_[i]);
-                        pushed = true;
-                        break;
-                    }
-                }
-            }
-            if (!pushed) {
-                expl.push(cur->children_[splits-1]);
+            size_t pivots = cur->pivots_.size();
+            T value = (*query)[cur->index_];
+            //the first pivot not below the value takes the query unless it ties
+            size_t i = count_below(cur->pivots_.data(), pivots, value);
+            if (i < pivots && value == cur->pivots_[i]) {
+                //Can use tie_left_pivot when search
+                //It doesn't matters where it goes when the tie range is smaller than the spill range, apply left tie won't hurt.
+                //If tie range is larger than the spill range, left tie alone can determine which leaf to go.
+                double product = dot(*query, cur->tie_breaker_);
+                while (i < pivots && value == cur->pivots_[i] && product > cur->tie_pivots_[i])
+                    i++;
             }
+            expl.push(cur->children_[i]);
         }
         else
             return cur->domain_;
@@ -26,6 +26,10 @@ class PCASpillTree;
  * Functions(s)     : PCASpillTree(size_t, double, DataSet<Label, T> &)
  *                          - Creates a spill tree with given min leaf size
  *                            and the spill factor
+ *                    PCASpillTree(size_t, double, double, DataSet<Label, T> &)
+ *                          - Creates a spill tree whose spill factor, at
+ *                            most the given one, adapts per node to keep
+ *                            the space blowup within a budget
  *                    PCASpillTree(ifStream & in, DataSet<Label, T> & st)
  *                          - De-serializes a spill tree
  */
@@ -34,16 +38,19 @@ class PCASpillTree : public PCATree<Label, T>
 {
 private:
     static PCATreeNode<Label, T> * build_tree(size_t min_leaf_size, double spill_factor,
-            DataSet<Label, T> & st, vector<size_t> domain);
+            DataSet<Label, T> & st, vector<size_t> domain, const vector<double> & parent_dir,
+            double budget = 0);
 public:
     PCASpillTree(DataSet<Label, T> & st);
     PCASpillTree(size_t min_leaf_size, double a, DataSet<Label, T> & st);
+    PCASpillTree(size_t min_leaf_size, double a, double max_blowup, DataSet<Label, T> & st);
     PCASpillTree(ifstream & in, DataSet<Label, T> & st);
 };
 
 template<class Label, class T>
 PCATreeNode<Label, T> * PCASpillTree<Label, T>::build_tree(size_t min_leaf_size, double spill_factor,
-        DataSet<Label, T> & st, vector<size_t> domain)
+        DataSet<Label, T> & st, vector<size_t> domain, const vector<double> & parent_dir,
+        double budget)
 {
     LOG_FINE("Enter build_tree\n");
     LOG_FINE("with min_leaf_size = %ld and domain.size = %ld\n", min_leaf_size, domain.size());
@@ -54,17 +61,24 @@ PCATreeNode<Label, T> * PCASpillTree<Label, T>::build_tree(size_t min_leaf_size,
     }
     DataSet<Label, T> subst = st.subset(domain);
 
-	/*find dominant eigenvector*/
-    vector<double> mx_var_dir = max_eigen_vector(subst, 1000);
+	/*find dominant eigenvector, starting from the parent's*/
+    vector<double> mx_var_dir = power_eigen_vector(subst, PCA_EIGEN_SAMPLES,
+            parent_dir, PCA_EIGEN_TOLERANCE, PCA_EIGEN_ITERATIONS);
 
 	/*project all the data at the dominant eigenvector*/
     vector<double> values;
     for (size_t i = 0; i < subst.size(); i++)
         values.push_back(dot(*subst[i], mx_var_dir));
 
+	/*spill less than spill_factor where a budget is left to spend*/
+	double a_value = spill_factor;
+	if (budget > 0)
+		a_value = budget_spill_factor(values, spill_factor, budget, min_leaf_size);
+	LOG_FINE("> spill factor = %lf\n", a_value);
+
 	/*find size limit for spill, left/right child, and half child*/
-	size_t spill_size_lim = (size_t)(values.size() * spill_factor * 2);
-	size_t child_size_lim = (size_t)(values.size() * (0.5 - spill_factor));
+	size_t spill_size_lim = (size_t)(values.size() * a_value * 2);
+	size_t child_size_lim = (size_t)(values.size() * (0.5 - a_value));
 	size_t half_size_lim = (size_t)(values.size() * 0.5);
 
 	double pivot = selector(values, half_size_lim);
@@ -93,8 +107,11 @@ PCATreeNode<Label, T> * PCASpillTree<Label, T>::build_tree(size_t min_leaf_size,
 	}
 
 	PCATreeNode<Label, T> * result = new PCATreeNode<Label, T> (mx_var_dir, pivot, domain);
-    result->set_left(build_tree(min_leaf_size, spill_factor, st, subdomain_l));
-    result->set_right(build_tree(min_leaf_size, spill_factor, st, subdomain_r));
+    double child_budget = 0;
+    if (budget > 0)
+        child_budget = budget * domain.size() / (subdomain_l.size() + subdomain_r.size());
+    result->set_left(build_tree(min_leaf_size, spill_factor, st, subdomain_l, mx_var_dir, child_budget));
+    result->set_right(build_tree(min_leaf_size, spill_factor, st, subdomain_r, mx_var_dir, child_budget));
     LOG_FINE("> sdl = %ld\n", subdomain_l.size());
     LOG_FINE("> sdr = %ld\n", subdomain_r.size());
     LOG_FINE("Exit build_tree\n");
@@ -119,7 +136,19 @@ PCASpillTree<Label, T>::PCASpillTree(size_t min_leaf_size, double spill_factor,
 { 
     LOG_INFO("PCASpillTree Constructed\n"); 
     LOG_FINE("with min_leaf_size = %ld, spill_factor = %lf\n", min_leaf_size, spill_factor);
-    this->set_root(build_tree(min_leaf_size, spill_factor, st, st.get_domain()));
+    this->set_root(build_tree(min_leaf_size, spill_factor, st, st.get_domain(), vector<double>()));
+}
+
+template<class Label, class T>
+PCASpillTree<Label, T>::PCASpillTree(size_t min_leaf_size, double spill_factor, double max_blowup,
+        DataSet<Label, T> & st) :
+  PCATree<Label, T>(st)
+{
+    LOG_INFO("PCASpillTree Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, spill_factor = %lf, max_blowup = %lf\n",
+            min_leaf_size, spill_factor, max_blowup);
+    this->set_root(build_tree(min_leaf_size, spill_factor, st, st.get_domain(), vector<double>(),
+                max_blowup));
 }
 
 template<class Label, class T>
@@ -5,12 +5,157 @@
 #ifndef PCA_TREE_H_
 #define PCA_TREE_H_
 
+#include <algorithm>
+#include <cmath>
 #include <queue>
 #include <map>
+#include <set>
 #include "vector_math.h"
 #include "data_set.h"
 using namespace std;
 
+/* Settings of the power iteration finding each split direction */
+#ifndef PCA_EIGEN_SAMPLES
+#define PCA_EIGEN_SAMPLES       (1000)
+#endif
+#ifndef PCA_EIGEN_TOLERANCE
+#define PCA_EIGEN_TOLERANCE     (1e-3)
+#endif
+#ifndef PCA_EIGEN_ITERATIONS
+#define PCA_EIGEN_ITERATIONS    (100)
+#endif
+
+/*
+ * On disk, PCA_SPARSE_DIR flags the dimension of a node followed by a
+ * sparse direction instead of a dense one.
+ */
+#define PCA_SPARSE_DIR          ((size_t)1 << 63)
+
+/* Settings of the two-means split rule */
+#ifndef TWO_MEANS_SAMPLES
+#define TWO_MEANS_SAMPLES       (1000)
+#endif
+#ifndef TWO_MEANS_ITERATIONS
+#define TWO_MEANS_ITERATIONS    (5)
+#endif
+#ifndef TWO_MEANS_MIN_BALANCE
+#define TWO_MEANS_MIN_BALANCE   (0.25)
+#endif
+
+/*
+ * How a node of a PCA, RP or V^2 tree picks its split. SPLIT_MEDIAN cuts
+ * its own direction at the median; SPLIT_TWO_MEANS cuts the hyperplane
+ * bisecting two centroids, see two_means_pivot.
+ */
+enum SplitRule
+{
+    SPLIT_MEDIAN,
+    SPLIT_TWO_MEANS
+};
+
+/*
+ * Name             : two_means_pivot
+ * Prototype        : double two_means_pivot(DataSet<Label, T> &, vector<double> &,
+ *                                           vector<double> &, size_t &)
+ * Description      : Runs TWO_MEANS_ITERATIONS rounds of 2-means on up to
+ *                    TWO_MEANS_SAMPLES vectors of the subset, seeded by
+ *                    cutting the node's own direction at its median, and
+ *                    replaces the direction by the one joining the two
+ *                    centroids. The pivot is the hyperplane bisecting them,
+ *                    moved just enough that each child keeps at least
+ *                    TWO_MEANS_MIN_BALANCE of the subset. The direction is
+ *                    kept when the centroids meet.
+ * Parameter(s)     : subset  - The vectors of the node
+ *                    dir     - The node's direction, set to the new one
+ *                    values  - The projections of the subset on dir, set to
+ *                              those on the new direction
+ *                    l_lim   - Set to the size of the left child
+ * Return Value     : The pivot
+ */
+template<class Label, class T>
+double two_means_pivot(DataSet<Label, T> & subset, vector<double> & dir,
+        vector<double> & values, size_t & l_lim)
+{
+    LOG_FINE("Enter two_means_pivot\n");
+    LOG_FINE("with subset.size = %ld\n", subset.size());
+    size_t num = subset.size();
+    size_t dim = (*subset[0]).size();
+    double median = selector(values, (size_t)(num * 0.5));
+    l_lim = (size_t)(num * 0.5);
+
+    //random samples, a partial shuffle of the indices
+    vector<size_t> sample;
+    for (size_t i = 0; i < num; i++) sample.push_back(i);
+    size_t sample_size = min(num, (size_t)TWO_MEANS_SAMPLES);
+    for (size_t i = 0; i < sample_size; i++)
+        swap(sample[i], sample[uniform_int_distribution<size_t>(i, num - 1)(thread_generator())]);
+    sample.resize(sample_size);
+    vector<bool> right (sample_size);
+    for (size_t i = 0; i < sample_size; i++)
+        right[i] = values[sample[i]] > median;
+
+    //x is nearer the right centroid iff dot(x, c_r - c_l) > (|c_r|^2 - |c_l|^2) / 2
+    vector<double> w (dim);
+    double bias = 0;
+    for (size_t it = 0; it <= TWO_MEANS_ITERATIONS; it++) {
+        vector<double> c_l (dim, 0.), c_r (dim, 0.);
+        size_t n_l = 0, n_r = 0;
+        for (size_t i = 0; i < sample_size; i++) {
+            const vector<T> & v = *subset[sample[i]];
+            vector<double> & c = right[i] ? c_r : c_l;
+            for (size_t j = 0; j < dim; j++)
+                c[j] += (double)v[j];
+            (right[i] ? n_r : n_l)++;
+        }
+        if (n_l == 0 || n_r == 0)
+            break;
+        double norm_l = 0, norm_r = 0;
+        for (size_t j = 0; j < dim; j++) {
+            c_l[j] /= n_l;
+            c_r[j] /= n_r;
+            w[j] = c_r[j] - c_l[j];
+            norm_l += c_l[j] * c_l[j];
+            norm_r += c_r[j] * c_r[j];
+        }
+        bias = (norm_r - norm_l) * 0.5;
+        if (it == TWO_MEANS_ITERATIONS)
+            break;
+        bool moved = false;
+        for (size_t i = 0; i < sample_size; i++) {
+            bool r = dot(*subset[sample[i]], w) > bias;
+            moved = moved || r != right[i];
+            right[i] = r;
+        }
+        if (!moved)
+            break;
+    }
+    double norm = sqrt(dot(w, w));
+    if (norm == 0) {
+        LOG_FINE("Exit two_means_pivot with the median\n");
+        return median;
+    }
+    for (size_t j = 0; j < dim; j++)
+        w[j] /= norm;
+    double pivot = bias / norm;
+    for (size_t i = 0; i < num; i++)
+        values[i] = dot(*subset[i], w);
+    dir = w;
+
+    //keep both children within the balance limits
+    size_t min_size = max((size_t)1, (size_t)(num * TWO_MEANS_MIN_BALANCE));
+    l_lim = 0;
+    for (size_t i = 0; i < num; i++)
+        if (values[i] <= pivot)
+            l_lim++;
+    if (l_lim < min_size || l_lim > num - min_size) {
+        l_lim = l_lim < min_size ? min_size : num - min_size;
+        pivot = selector(values, l_lim);
+    }
+    LOG_FINE("Exit two_means_pivot\n");
+    LOG_FINE("with l_lim = %ld\n", l_lim);
+    return pivot;
+}
+
 /* Class Prototypes */
 template<class Label, class T>
 class PCATreeNode;
@@ -25,30 +170,50 @@ class PCATree;
  * Name             : PCATreeNode
  * Description      : Data structure to hold a node of a KDTree
  * Data Field(s)    : dir_      - Direction to project the distance onto
+ *                    sparse_dir_ - Sparse direction to project onto instead,
+ *                                  see random_sparse_direction
+ *                    dimension_  - The dimension of a sparse direction
  *                    pivot_    - The value to pivot on
  *                    left_     - Pointer to left subtree node
  *                    right_    - Pointer to right subtree node
  *                    domain_   - vectors out of vector space in data set
+ *                    spill_l_  - Lower end of the projected spill band
+ *                    spill_r_  - Upper end of the projected spill band
+ *                    norm_     - Length of the direction, 1 for a leaf
  * Functions(s)     : PCATreeNode(const vector<size_t>) 
  *                              - Create a PCATreeNode of given domain (leaf)
- *                    PCATreeNode(size_t, T, vector<size_t>)
+ *                    PCATreeNode(vector<double>, double, vector<size_t>)
  *                              - Create a PCATreeNode of given domain (non-leaf)
+ *                    PCATreeNode(vector<uint32_t>, size_t, double, vector<size_t>)
+ *                              - Create a PCATreeNode of given domain
+ *                                projecting on a sparse direction
  *                    PCATreeNode(ifstream &)
  *                              - Creates a KDTreeNode through de-serialization
  *                    vector<double> get_direction() const
  *                              - Returns the direction to project the distance onto
+ *                    bool is_sparse() const
+ *                              - Whether the direction is sparse
+ *                    double project(const vector<T> &) const
+ *                              - Returns the projection of a vector on the direction
+ *                    double margin(const vector<T> &) const
+ *                              - Returns the signed distance of a vector to
+ *                                the split hyperplane
  *                    size_t get_index() const
  *                              - Gets index of max variance
  *                    PCATreeNode * get_left() const
  *                              - Returns pointer to left subtree node
  *                    PCATreeNode * get_right() const
  *                              - Returns pointer to right subtree node
- *                    vector<size_t> get_domain() const
+ *                    const vector<size_t> & get_domain() const
  *                              - Returns the domain the node stores
  *                    void set_left(PCATreeNode *)
  *                              - Sets the left subtree node
  *                    void set_right(PCATreeNode *)
  *                              - Sets the right subtree node
+ *                    double get_spill_l() const, double get_spill_r() const
+ *                              - Return the spill band
+ *                    void set_spill_range(double, double)
+ *                              - Sets the spill band
  *                    void save(ofstream &)
  *                              - Serializes node 
  */
@@ -58,27 +223,45 @@ class PCATreeNode
 protected:
     PCATreeNode * left_, * right_;
     vector<double> dir_;
+    vector<uint32_t> sparse_dir_;
+    size_t dimension_;
     double pivot_;
     vector<size_t> domain_;
+    double spill_l_, spill_r_;
+    double norm_;
+    void set_norm();
 public:
     PCATreeNode(const vector<size_t> domain);
     PCATreeNode(vector<double> dir, double pivot, vector<size_t> domain);
+    PCATreeNode(vector<uint32_t> sparse_dir, size_t dimension, double pivot, vector<size_t> domain);
     PCATreeNode(ifstream & in);
     ~PCATreeNode();
     vector<double> get_direction() const
-    { return dir_; }
+    { return is_sparse() ? dense_direction(sparse_dir_, dimension_) : dir_; }
+    bool is_sparse() const
+    { return !sparse_dir_.empty(); }
+    double project(const vector<T> & v) const
+    { return is_sparse() ? sparse_dot(v, sparse_dir_) : dot(v, dir_); }
+    double margin(const vector<T> & v) const
+    { return (project(v) - pivot_) / norm_; }
     double get_pivot() const
     { return pivot_; }
     PCATreeNode * get_left() const
     { return left_; }
     PCATreeNode * get_right() const
     { return right_; }
-    vector<size_t> get_domain() const
+    const vector<size_t> & get_domain() const
     { return domain_; }
     void set_left(PCATreeNode * left)
     { left_ = left; };
     void set_right(PCATreeNode * right)
     { right_ = right; };
+    double get_spill_l() const
+    { return spill_l_; }
+    double get_spill_r() const
+    { return spill_r_; }
+    void set_spill_range(double spill_l, double spill_r)
+    { spill_l_ = spill_l; spill_r_ = spill_r; }
     virtual void save(ofstream & out) const;
     friend class PCATree<Label, T>;
 };
@@ -93,6 +276,9 @@ public:
  *                    PCATree(size_t, DataSet<Label, T>)
  *                          - Creates a tree of given min leaf size and
  *                            data set
+ *                    PCATree(size_t, SplitRule, DataSet<Label, T>)
+ *                          - Creates a tree of given min leaf size, data
+ *                            set and split rule
  *                    PCATree(ifstream &, DataSet<Label, T>)
  *                          - De-serialization 
  *                    ~PCATree()
@@ -105,19 +291,29 @@ public:
  *                          - Serializes the tree
  *                    vector<size_t> subdomain(vector<T> *, size_t)
  *                          - Queries the tree for a subdomain
+ *                    void set_spill_ranges(double)
+ *                          - Sets the spill band of every node from the
+ *                            quantiles of its projected domain
+ *                    vector<size_t> spill_subdomain(vector<T> *, size_t, size_t *, double)
+ *                          - Queries the tree for a subdomain, exploring
+ *                            both children of the nodes whose band holds
+ *                            the query's projection, or whose hyperplane
+ *                            is within margin of the query
  */
 template<class Label, class T>
 class PCATree
 {
 private:
     static PCATreeNode<Label, T> * build_tree(size_t c,
-            DataSet<Label, T> & st, vector<size_t> domain);
+            DataSet<Label, T> & st, vector<size_t> domain,
+            const vector<double> & parent_dir, SplitRule rule = SPLIT_MEDIAN);
 protected:
     PCATreeNode<Label, T> * root_;
     DataSet<Label, T> & st_;
 public:
     PCATree(DataSet<Label, T> & st);
     PCATree(size_t min_leaf_size, DataSet<Label, T> & st);
+    PCATree(size_t min_leaf_size, SplitRule rule, DataSet<Label, T> & st);
     PCATree(ifstream & in, DataSet<Label, T> & st);
     ~PCATree();
     PCATreeNode<Label, T> * get_root() const
@@ -128,11 +324,15 @@ public:
     { root_ = root; }
     virtual void save(ofstream & out) const;
     virtual vector<size_t> subdomain(vector<T> * query, size_t l_c = 0);
+    void set_spill_ranges(double a_value);
+    vector<size_t> spill_subdomain(vector<T> * query, size_t leaf_size,
+            size_t * number_of_leaves, double margin = -1) const;
 };
 
 template<class Label, class T>
 PCATreeNode<Label, T> * PCATree<Label, T>::build_tree(size_t min_leaf_size,
-        DataSet<Label, T> & st, vector<size_t> domain)
+        DataSet<Label, T> & st, vector<size_t> domain, const vector<double> & parent_dir,
+        SplitRule rule)
 {
     LOG_FINE("Enter build_tree\n");
     LOG_FINE("with min_leaf_size = %ld and domain.size = %ld\n", min_leaf_size, domain.size());
@@ -143,20 +343,27 @@ PCATreeNode<Label, T> * PCATree<Label, T>::build_tree(size_t min_leaf_size,
     }
     DataSet<Label, T> subst = st.subset(domain);
 
-	/*find dominant eigenvector*/
-    vector<double> mx_var_dir = max_eigen_vector(subst, 1000);
+	/*find dominant eigenvector, starting from the parent's*/
+    vector<double> mx_var_dir = power_eigen_vector(subst, PCA_EIGEN_SAMPLES,
+            parent_dir, PCA_EIGEN_TOLERANCE, PCA_EIGEN_ITERATIONS);
 
 	/*project all the data at the dominant eigenvector*/
     vector<double> values;
     for (size_t i = 0; i < subst.size(); i++)
         values.push_back(dot(*subst[i], mx_var_dir));
 
-	/*find pivot to split*/
-    double pivot = selector(values, (size_t)(values.size() * 0.5));
+	/*find pivot to split, moving to the two-means direction if asked*/
+    double pivot;
+    size_t subdomain_l_lim;
+    if (rule == SPLIT_TWO_MEANS)
+        pivot = two_means_pivot(subst, mx_var_dir, values, subdomain_l_lim);
+    else {
+        pivot = selector(values, (size_t)(values.size() * 0.5));
+        subdomain_l_lim = (size_t)(values.size() * 0.5);
+    }
 
 	/*split to left and right child*/
     vector<size_t> subdomain_l;
-    size_t subdomain_l_lim = (size_t)(values.size() * 0.5);
     LOG_FINE("> left_lim = %ld\n", subdomain_l_lim);
     vector<size_t> subdomain_r;
     for (size_t i = 0; i < domain.size(); i++) {
@@ -168,8 +375,8 @@ PCATreeNode<Label, T> * PCATree<Label, T>::build_tree(size_t min_leaf_size,
 
     PCATreeNode<Label, T> * result = new PCATreeNode<Label, T>(mx_var_dir, 
             pivot, domain);
-    result->left_ = build_tree(min_leaf_size, st, subdomain_l);
-    result->right_ = build_tree(min_leaf_size, st, subdomain_r);
+    result->left_ = build_tree(min_leaf_size, st, subdomain_l, mx_var_dir, rule);
+    result->right_ = build_tree(min_leaf_size, st, subdomain_r, mx_var_dir, rule);
     LOG_FINE("> sdl = %ld\n", subdomain_l.size());
     LOG_FINE("> sdr = %ld\n", subdomain_r.size());
     LOG_FINE("Exit build_tree\n");
@@ -179,10 +386,14 @@ PCATreeNode<Label, T> * PCATree<Label, T>::build_tree(size_t min_leaf_size,
 template<class Label, class T>
 PCATreeNode<Label, T>::PCATreeNode(const vector<size_t> domain) :
   dir_ (),
+  dimension_ (0),
   pivot_ (0),
   left_ (NULL),
   right_ (NULL),
-  domain_ (domain)
+  domain_ (domain),
+  spill_l_ (0),
+  spill_r_ (0),
+  norm_ (1)
 { 
     LOG_FINE("PCATreeNode Constructed\n"); 
     LOG_FINE("with domain.size = %ld\n", domain.size());
@@ -192,22 +403,55 @@ template<class Label, class T>
 PCATreeNode<Label, T>::PCATreeNode(vector<double> dir, 
         double pivot, vector<size_t> domain) :
   dir_ (dir),
+  dimension_ (0),
   pivot_ (pivot),
   left_ (NULL), 
   right_ (NULL),
-  domain_ (domain)
+  domain_ (domain),
+  spill_l_ (0),
+  spill_r_ (0)
 { 
     LOG_FINE("PCATreeNode Constructed\n"); 
     LOG_FINE("with domain.size = %ld\n", domain.size());
+    set_norm();
 }
 
 template<class Label, class T>
-PCATreeNode<Label, T>::PCATreeNode(ifstream & in)
+PCATreeNode<Label, T>::PCATreeNode(vector<uint32_t> sparse_dir, size_t dimension,
+        double pivot, vector<size_t> domain) :
+  dir_ (),
+  sparse_dir_ (sparse_dir),
+  dimension_ (dimension),
+  pivot_ (pivot),
+  left_ (NULL),
+  right_ (NULL),
+  domain_ (domain),
+  spill_l_ (0),
+  spill_r_ (0)
+{
+    LOG_FINE("PCATreeNode Constructed\n");
+    LOG_FINE("with domain.size = %ld, %ld nonzeros\n", domain.size(), sparse_dir.size());
+    set_norm();
+}
+
+template<class Label, class T>
+PCATreeNode<Label, T>::PCATreeNode(ifstream & in) :
+  dimension_ (0),
+  spill_l_ (0),
+  spill_r_ (0)
 {
     LOG_FINE("PCATreeNode Constructed\n"); 
     LOG_FINE("with input stream\n");
     size_t dim;
     in.read((char *)&dim, sizeof(size_t));
+    if (dim & PCA_SPARSE_DIR) {
+        dimension_ = dim & ~PCA_SPARSE_DIR;
+        size_t nonzeros;
+        in.read((char *)&nonzeros, sizeof(size_t));
+        sparse_dir_.resize(nonzeros);
+        in.read((char *)sparse_dir_.data(), sizeof(uint32_t) * nonzeros);
+        dim = 0;
+    }
     while (dim--) {
         double v;
         in.read((char *)&v, sizeof(double));
@@ -221,6 +465,20 @@ PCATreeNode<Label, T>::PCATreeNode(ifstream & in)
         in.read((char *)&v, sizeof(size_t));
         domain_.push_back(v);
     }
+    set_norm();
+}
+
+/*
+ * Caches the length of the direction, so that margins at nodes whose
+ * directions are not unit length, as rp and v2 directions are not, compare
+ * as distances. Sparse directions have entries of +-1.
+ */
+template<class Label, class T>
+void PCATreeNode<Label, T>::set_norm()
+{
+    norm_ = is_sparse() ? sqrt((double)sparse_dir_.size()) : sqrt(dot(dir_, dir_));
+    if (!(norm_ > 0))
+        norm_ = 1;
 }
 
 template<class Label, class T>
@@ -242,14 +500,21 @@ void PCATreeNode<Label, T>::save(ofstream & out) const
 {
     LOG_FINE("Saving PCATreeNode\n"); 
     LOG_FINE("> domain.size = %ld\n", domain_.size());
-    size_t dim = dir_.size();
-    out.write((char *)&dim, sizeof(size_t));
-	if (dir_.empty()) {
-		out.write((char *)&dir_, sizeof(double) * dim);
-	}
-	else {
-		out.write((char *)&dir_[0], sizeof(double) * dim);
-	}
+    if (is_sparse()) {
+        size_t flagged = dimension_ | PCA_SPARSE_DIR;
+        size_t nonzeros = sparse_dir_.size();
+        out.write((char *)&flagged, sizeof(size_t));
+        out.write((char *)&nonzeros, sizeof(size_t));
+        out.write((char *)sparse_dir_.data(), sizeof(uint32_t) * nonzeros);
+    }
+    else {
+        size_t dim = dir_.size();
+        out.write((char *)&dim, sizeof(size_t));
+        if (dir_.empty())
+            out.write((char *)&dir_, sizeof(double) * dim);
+        else
+            out.write((char *)&dir_[0], sizeof(double) * dim);
+    }
     out.write((char *)&pivot_, sizeof(double)); 
     size_t sz = domain_.size();
     out.write((char *)&sz, sizeof(size_t)); 
@@ -268,13 +533,22 @@ PCATree<Label, T>::PCATree(DataSet<Label, T> & st) :
 
 template<class Label, class T>
 PCATree<Label, T>::PCATree(size_t min_leaf_size, DataSet<Label, T> & st) :
-  root_ (build_tree(min_leaf_size, st, st.get_domain())),
+  root_ (build_tree(min_leaf_size, st, st.get_domain(), vector<double>())),
   st_ (st)
 { 
     LOG_INFO("PCATree Constructed\n");
     LOG_FINE("with min_leaf_size = %ld", min_leaf_size);
 }
 
+template<class Label, class T>
+PCATree<Label, T>::PCATree(size_t min_leaf_size, SplitRule rule, DataSet<Label, T> & st) :
+  root_ (build_tree(min_leaf_size, st, st.get_domain(), vector<double>(), rule)),
+  st_ (st)
+{
+    LOG_INFO("PCATree Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, rule = %d", min_leaf_size, (int)rule);
+}
+
 template<class Label, class T>
 PCATree<Label, T>::PCATree(ifstream & in, DataSet<Label, T> & st) :
   st_ (st)
@@ -336,7 +610,7 @@ vector<size_t> PCATree<Label, T>::subdomain(vector<T> * query, size_t leaf_size)
         expl.pop();
         if (cur->left_ && cur->right_ &&
             cur->domain_.size() >= leaf_size) {
-            if (dot(*query, cur->dir_) <= cur->pivot_)
+            if (cur->project(*query) <= cur->pivot_)
                 expl.push(cur->left_);
             else
                 expl.push(cur->right_);
@@ -347,4 +621,75 @@ vector<size_t> PCATree<Label, T>::subdomain(vector<T> * query, size_t leaf_size)
     LOG_FINE("Exit subdomain\n");
     return vector<size_t>();
 }
+
+/*
+ * The band of a node spans the projections ranked (0.5 - a_value) and
+ * (0.5 + a_value) in its domain, as the spill trees split them.
+ */
+template<class Label, class T>
+void PCATree<Label, T>::set_spill_ranges(double a_value)
+{
+    LOG_INFO("Setting spill ranges with alpha = %lf\n", a_value);
+    queue<PCATreeNode<Label, T> *> to_update;
+    to_update.push(root_);
+    while (!to_update.empty()) {
+        PCATreeNode<Label, T> * cur = to_update.front();
+        to_update.pop();
+        if (!cur || !cur->left_ || !cur->right_ || cur->domain_.empty())
+            continue;
+        vector<double> values (cur->domain_.size());
+        for (size_t i = 0; i < cur->domain_.size(); i++)
+            values[i] = cur->project(*st_[cur->domain_[i]]);
+        sort(values.begin(), values.end());
+        size_t k_l = (size_t)(values.size() * (0.5 - a_value));
+        size_t k_r = (size_t)(values.size() * (0.5 + a_value));
+        cur->set_spill_range(values[k_l ? min(k_l, values.size()) - 1 : 0],
+                values[k_r ? min(k_r, values.size()) - 1 : 0]);
+        to_update.push(cur->left_);
+        to_update.push(cur->right_);
+    }
+}
+
+/*
+ * Explores both children of a node when the query's projection lies in the
+ * node's band, or within distance margin of its split hyperplane if margin
+ * is not negative, and returns the union of the leaves reached.
+ */
+template<class Label, class T>
+vector<size_t> PCATree<Label, T>::spill_subdomain(vector<T> * query, size_t leaf_size,
+        size_t * number_of_leaves, double margin) const
+{
+    LOG_FINE("Enter spill_subdomain\n");
+    LOG_FINE("with leaf_size = %ld, margin = %lf\n", leaf_size, margin);
+    queue<PCATreeNode<Label, T> *> expl;
+    set<size_t> domain_st;
+    expl.push(root_);
+    while (!expl.empty()) {
+        PCATreeNode<Label, T> * cur = expl.front();
+        expl.pop();
+        if (cur->left_ && cur->right_ &&
+            cur->domain_.size() >= leaf_size) {
+            double product = cur->project(*query);
+            bool spill = margin < 0 ?
+                (cur->spill_l_ <= product && product < cur->spill_r_) :
+                fabs(product - cur->pivot_) <= margin * cur->norm_;
+            if (spill) {
+                expl.push(cur->left_);
+                expl.push(cur->right_);
+            }
+            else if (product <= cur->pivot_)
+                expl.push(cur->left_);
+            else
+                expl.push(cur->right_);
+        }
+        else {
+            if (number_of_leaves)
+                (*number_of_leaves)++;
+            domain_st.insert(cur->domain_.begin(), cur->domain_.end());
+        }
+    }
+    LOG_FINE("Exit spill_subdomain\n");
+    return vector<size_t>(domain_st.begin(), domain_st.end());
+}
+
 #endif
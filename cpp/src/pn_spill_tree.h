@@ -0,0 +1,350 @@
+/*
+ * File             : pn_spill_tree.h
+ * Summary          : Infrastructure to hold a spill tree with n children
+ *                    per node, split at n-1 quantiles of a projection on a
+ *                    PCA or random direction, with a spill band around
+ *                    each pivot.
+ */
+#ifndef PN_SPILL_TREE_H_
+#define PN_SPILL_TREE_H_
+
+#include <algorithm>
+#include <queue>
+#include "logging.h"
+#include "data_set.h"
+#include "vector_math.h"
+#include "pca_tree.h"
+using namespace std;
+
+/* Class Prototypes */
+
+template<class Label, class T>
+class PNSpillTreeNode;
+
+template<class Label, class T>
+class PNSpillTree;
+
+/* Class Definitions */
+
+/*
+ * Name             : PNSpillTreeNode
+ * Description      : Data structure to hold a node of a PNSpillTree
+ * Data Field(s)    : dir_      - The projection direction
+ *                    pivots_   - sorted n-1 projected pivots, cache-line aligned
+ *                    children_ - vector of n subtree nodes, empty for a leaf
+ *                    domain_   - vectors out of vector space in data set
+ * Functions(s)     : PNSpillTreeNode(const vector<size_t> &)
+ *                              - Create a PNSpillTreeNode of given domain (leaf)
+ *                    PNSpillTreeNode(const vector<double> &, const vector<double> &,
+ *                                    const vector<PNSpillTreeNode *> &, const vector<size_t> &)
+ *                              - Create a PNSpillTreeNode of given direction,
+ *                                pivots, children and domain (non-leaf)
+ *                    PNSpillTreeNode(ifstream &)
+ *                              - Creates a PNSpillTreeNode through de-serialization
+ *                    const vector<double> & get_dir() const
+ *                              - Returns the projection direction
+ *                    const vector<size_t> & get_domain() const
+ *                              - Returns the domain the node stores
+ *                    size_t get_splits() const
+ *                              - Returns the number of children
+ *                    PNSpillTreeNode * get_child(size_t) const
+ *                              - Returns a child
+ *                    void save(ofstream &)
+ *                              - Serializes node
+ */
+template<class Label, class T>
+class PNSpillTreeNode
+{
+protected:
+    vector<double> dir_;
+    vector<double, aligned_allocator<double> > pivots_;
+    vector<PNSpillTreeNode *> children_;
+    vector<size_t> domain_;
+public:
+    PNSpillTreeNode(const vector<size_t> & domain);
+    PNSpillTreeNode(const vector<double> & dir, const vector<double> & pivots,
+                    const vector<PNSpillTreeNode *> & children, const vector<size_t> & domain);
+    PNSpillTreeNode(ifstream & in);
+    ~PNSpillTreeNode();
+    const vector<double> & get_dir() const
+    { return dir_; }
+    const vector<size_t> & get_domain() const
+    { return domain_; }
+    size_t get_splits() const
+    { return children_.size(); }
+    PNSpillTreeNode * get_child(size_t i) const
+    { return children_[i]; }
+    void save(ofstream & out) const;
+
+    friend class PNSpillTree<Label, T>;
+};
+
+/*
+ * Name             : PNSpillTree
+ * Description      : Encapsulates the PNSpillTreeNodes into a tree. One
+ *                    projection routes a query through n children, so a
+ *                    query costs about log_n of the leaves in dot products
+ *                    instead of log_2 for the binary PCA and RP trees.
+ * Data Field(s)    : root_ - Holds the root node of tree
+ *                    st_   - Holds the data set associated with tree
+ * Function(s)      : PNSpillTree(size_t, size_t, double, bool, DataSet<Label, T> &)
+ *                          - Creates a tree of given min leaf size, number
+ *                            of splits and spill factor, projecting on PCA
+ *                            directions or, if asked, random ones
+ *                    PNSpillTree(ifstream &, DataSet<Label, T> &)
+ *                          - De-serialization
+ *                    ~PNSpillTree()
+ *                          - Deconstructor
+ *                    PNSpillTreeNode<Label, T> * get_root() const
+ *                          - Returns the root
+ *                    DataSet<Label, T> & get_st() const
+ *                          - Returns the set associated with the tree
+ *                    void save(ofstream &) const
+ *                          - Serializes the tree
+ *                    vector<size_t> subdomain(vector<T> *, size_t, size_t *) const
+ *                          - Queries the tree for a subdomain, optionally
+ *                            counting the projections taken
+ */
+template<class Label, class T>
+class PNSpillTree
+{
+private:
+    PNSpillTreeNode<Label, T> * root_;
+    DataSet<Label, T> & st_;
+    PNSpillTree(const PNSpillTree &);
+    PNSpillTree & operator=(const PNSpillTree &);
+    static PNSpillTreeNode<Label, T> * build_tree(size_t leaf_size, size_t splits,
+            double spill_factor, bool random_dir, DataSet<Label, T> & st,
+            const vector<size_t> & domain, const vector<double> & parent_dir);
+public:
+    PNSpillTree(size_t leaf_size, size_t splits, double spill_factor, bool random_dir,
+            DataSet<Label, T> & st);
+    PNSpillTree(ifstream & in, DataSet<Label, T> & st);
+    ~PNSpillTree();
+    PNSpillTreeNode<Label, T> * get_root() const
+    { return root_; }
+    DataSet<Label, T> & get_st() const
+    { return st_; }
+    void save(ofstream & out) const;
+    vector<size_t> subdomain(vector<T> * query, size_t l_c = 0, size_t * projections = NULL) const;
+};
+
+/**************** Private Functions *****************/
+
+/*
+ * Build tree of given minimum leaf size <leaf_size>, number of splits
+ * <splits> and spill factor <spill_factor> over the vector space <domain>.
+ * The points are ranked by their projection on the node's direction and
+ * child i takes the ranks of the i-th n-quantile, widened on each side by
+ * <spill_factor> of the node. The direction is the top eigenvector, found
+ * from <parent_dir>, or a random one if <random_dir> is set.
+ */
+template<class Label, class T>
+PNSpillTreeNode<Label, T> * PNSpillTree<Label, T>::build_tree(size_t leaf_size, size_t splits,
+        double spill_factor, bool random_dir, DataSet<Label, T> & st,
+        const vector<size_t> & domain, const vector<double> & parent_dir)
+{
+    LOG_FINE("Enter build_tree\n");
+    LOG_FINE("with leaf_size = %ld, splits = %ld and domain.size = %ld\n", leaf_size, splits,
+            domain.size());
+    if (domain.size() < leaf_size || domain.size() < 2 * splits) {
+        LOG_FINE("Exit build_tree");
+        LOG_FINE("by hitting base size");
+        return new PNSpillTreeNode<Label, T>(domain);
+    }
+    DataSet<Label, T> subst = st.subset(domain);
+
+    /*find the projection direction*/
+    vector<double> dir;
+    if (random_dir)
+        dir = random_tie_breaker((*subst[0]).size());
+    else
+        dir = power_eigen_vector(subst, PCA_EIGEN_SAMPLES, parent_dir,
+                PCA_EIGEN_TOLERANCE, PCA_EIGEN_ITERATIONS);
+
+    /*rank the points by their projection*/
+    size_t n = domain.size();
+    vector<double> values (n);
+    vector<size_t> order (n);
+    for (size_t i = 0; i < n; i++) {
+        values[i] = dot(*subst[i], dir);
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(),
+            [&values](size_t a, size_t b) { return values[a] < values[b]; });
+
+    /*cut at the quantiles, keeping every child smaller than the node*/
+    size_t full_child_size = n / splits;
+    size_t half_spill_size = min((size_t)(n * spill_factor), full_child_size / 2);
+    vector<double> pivots;
+    for (size_t i = 1; i < splits; i++)
+        pivots.push_back(values[order[full_child_size * i - 1]]);
+
+    vector<PNSpillTreeNode<Label, T> *> children;
+    for (size_t i = 0; i < splits; i++) {
+        size_t lo = full_child_size * i;
+        size_t hi = i + 1 == splits ? n : full_child_size * (i + 1);
+        lo = lo > half_spill_size ? lo - half_spill_size : 0;
+        hi = min(n, hi + half_spill_size);
+        vector<size_t> child;
+        for (size_t j = lo; j < hi; j++)
+            child.push_back(domain[order[j]]);
+        LOG_FINE("> child %ld size = %ld\n", i, child.size());
+        children.push_back(build_tree(leaf_size, splits, spill_factor, random_dir, st, child, dir));
+    }
+    LOG_FINE("Exit build_tree\n");
+    return new PNSpillTreeNode<Label, T>(dir, pivots, children, domain);
+}
+
+/**************** Public Functions *****************/
+
+template<class Label, class T>
+PNSpillTreeNode<Label, T>::PNSpillTreeNode(const vector<size_t> & domain) :
+  domain_ (domain)
+{
+    LOG_FINE("PNSpillTreeNode Constructed\n");
+    LOG_FINE("with domain.size = %ld\n", domain.size());
+}
+
+template<class Label, class T>
+PNSpillTreeNode<Label, T>::PNSpillTreeNode(const vector<double> & dir,
+        const vector<double> & pivots, const vector<PNSpillTreeNode *> & children,
+        const vector<size_t> & domain) :
+  dir_ (dir),
+  pivots_ (pivots.begin(), pivots.end()),
+  children_ (children),
+  domain_ (domain)
+{
+    LOG_FINE("PNSpillTreeNode Constructed\n");
+    LOG_FINE("with domain.size = %ld, children = %ld\n", domain.size(), children.size());
+}
+
+/*
+ * A node is stored as its number of children, its domain and, for a
+ * non-leaf, its direction and pivots. The children follow breadth first.
+ */
+template<class Label, class T>
+PNSpillTreeNode<Label, T>::PNSpillTreeNode(ifstream & in)
+{
+    LOG_FINE("PNSpillTreeNode Constructed\n");
+    LOG_FINE("with input stream\n");
+    size_t splits;
+    in.read((char *)&splits, sizeof(size_t));
+    size_t sz;
+    in.read((char *)&sz, sizeof(size_t));
+    domain_.resize(sz);
+    in.read((char *)domain_.data(), sizeof(size_t) * sz);
+    if (splits == 0)
+        return;
+    size_t dimension;
+    in.read((char *)&dimension, sizeof(size_t));
+    dir_.resize(dimension);
+    in.read((char *)dir_.data(), sizeof(double) * dimension);
+    pivots_.resize(splits - 1);
+    in.read((char *)pivots_.data(), sizeof(double) * (splits - 1));
+    children_.resize(splits, NULL);
+}
+
+template<class Label, class T>
+void PNSpillTreeNode<Label, T>::save(ofstream & out) const
+{
+    LOG_FINE("Saving PNSpillTreeNode\n");
+    size_t splits = children_.size();
+    out.write((char *)&splits, sizeof(size_t));
+    size_t sz = domain_.size();
+    out.write((char *)&sz, sizeof(size_t));
+    out.write((char *)domain_.data(), sizeof(size_t) * sz);
+    if (splits == 0)
+        return;
+    size_t dimension = dir_.size();
+    out.write((char *)&dimension, sizeof(size_t));
+    out.write((char *)dir_.data(), sizeof(double) * dimension);
+    out.write((char *)pivots_.data(), sizeof(double) * pivots_.size());
+}
+
+template<class Label, class T>
+PNSpillTreeNode<Label, T>::~PNSpillTreeNode()
+{
+    for (size_t i = 0; i < children_.size(); i++)
+        delete children_[i];
+    LOG_FINE("PNSpillTreeNode Deconstructed\n");
+}
+
+template<class Label, class T>
+PNSpillTree<Label, T>::PNSpillTree(size_t leaf_size, size_t splits, double spill_factor,
+        bool random_dir, DataSet<Label, T> & st) :
+  root_ (build_tree(leaf_size, max(splits, (size_t)2), spill_factor, random_dir, st,
+              st.get_domain(), vector<double>())),
+  st_ (st)
+{
+    LOG_INFO("PNSpillTree Constructed\n");
+    LOG_FINE("with leaf_size = %ld, splits = %ld, spill_factor = %lf, random_dir = %d\n",
+            leaf_size, splits, spill_factor, (int)random_dir);
+}
+
+template<class Label, class T>
+PNSpillTree<Label, T>::PNSpillTree(ifstream & in, DataSet<Label, T> & st) :
+  root_ (NULL),
+  st_ (st)
+{
+    LOG_INFO("PNSpillTree Constructed\n");
+    LOG_FINE("with input stream\n");
+    queue<PNSpillTreeNode<Label, T> **> to_load;
+    to_load.push(&root_);
+    while (!to_load.empty()) {
+        PNSpillTreeNode<Label, T> ** cur = to_load.front();
+        to_load.pop();
+        *cur = new PNSpillTreeNode<Label, T>(in);
+        for (size_t i = 0; i < (*cur)->children_.size(); i++)
+            to_load.push(&((*cur)->children_[i]));
+    }
+}
+
+template<class Label, class T>
+PNSpillTree<Label, T>::~PNSpillTree()
+{
+    delete root_;
+    LOG_INFO("PNSpillTree Deconstructed\n");
+}
+
+template<class Label, class T>
+void PNSpillTree<Label, T>::save(ofstream & out) const
+{
+    LOG_INFO("Saving PNSpillTree\n");
+    queue<const PNSpillTreeNode<Label, T> *> to_save;
+    to_save.push(root_);
+    while (!to_save.empty()) {
+        const PNSpillTreeNode<Label, T> * cur = to_save.front();
+        to_save.pop();
+        cur->save(out);
+        for (size_t i = 0; i < cur->children_.size(); i++)
+            to_save.push(cur->children_[i]);
+    }
+}
+
+/*
+ * Routes <query> down to the first node holding fewer than <l_c> points or
+ * to a leaf, taking one projection per level. The query goes to the child
+ * of the first pivot not below its projection. If <projections> is given,
+ * the number of projections is added to it.
+ */
+template<class Label, class T>
+vector<size_t> PNSpillTree<Label, T>::subdomain(vector<T> * query, size_t l_c,
+        size_t * projections) const
+{
+    LOG_FINE("Enter subdomain\n");
+    LOG_FINE("with lc = %ld\n", l_c);
+    const PNSpillTreeNode<Label, T> * cur = root_;
+    size_t taken = 0;
+    while (!cur->children_.empty() && cur->domain_.size() >= l_c) {
+        double value = dot(*query, cur->dir_);
+        taken++;
+        cur = cur->children_[count_below(cur->pivots_.data(), cur->pivots_.size(), value)];
+    }
+    if (projections)
+        *projections += taken;
+    LOG_FINE("Exit subdomain\n");
+    return cur->domain_;
+}
+
+#endif
@@ -79,7 +79,8 @@ KDTreeNode<Label, T> * RKDTree<Label, T>::build_tree(size_t min_leaf_size,
     //distribute pivot pool to all the children nodes
     //dot a random vector then do split again
     size_t dimension = (*subst[0]).size();
-    vector<double> tie_breaker = random_tie_breaker(dimension);
+    uint64_t tie_seed = random_tie_seed();
+    vector<double> tie_breaker = seeded_tie_breaker(tie_seed, dimension);
     
     //extract the vectors from dataset
     DataSet<Label, T> tie_vectors = st.subset(pivot_pool);
@@ -107,7 +108,7 @@ KDTreeNode<Label, T> * RKDTree<Label, T>::build_tree(size_t min_leaf_size,
     }
     
     
-    KDTreeNode<Label, T> * result = new KDTreeNode<Label, T> (mx_var_index, pivot, domain, dimension, tie_pivot, tie_breaker);
+    KDTreeNode<Label, T> * result = new KDTreeNode<Label, T> (mx_var_index, pivot, domain, dimension, tie_pivot, tie_seed);
     result->set_left(build_tree(min_leaf_size, st, subdomain_l));
     result->set_right(build_tree(min_leaf_size, st, subdomain_r));
     LOG_FINE("> sdl = %ld\n", subdomain_l.size());
@@ -0,0 +1,238 @@
+/*
+ * File             : rotated_kd_tree.h
+ * Summary          : Infrastructure to hold a kd tree built in a globally
+ *                    rotated space. The data set is rotated once, by its
+ *                    principal axes or by a randomized Hadamard transform,
+ *                    and a query is rotated once before it descends the
+ *                    tree with scalar comparisons.
+ */
+#ifndef ROTATED_KD_TREE_H_
+#define ROTATED_KD_TREE_H_
+
+#include <cmath>
+#include "Eigen/Core"
+#include "Eigen/Eigenvalues"
+#include "logging.h"
+#include "vector_math.h"
+#include "data_set.h"
+#include "kd_tree.h"
+using namespace std;
+
+/* Number of vectors sampled to estimate the covariance of the PCA rotation */
+#ifndef ROTATED_KD_PCA_SAMPLES
+#define ROTATED_KD_PCA_SAMPLES  (10000)
+#endif
+
+/* Kinds of rotation, as stored on disk */
+#define ROTATION_PCA            (0)
+#define ROTATION_HADAMARD       (1)
+
+/* Class Definitions */
+
+/*
+ * Name             : RotatedKDTree
+ * Description      : A kd tree of the data set after one orthogonal
+ *                    transform. The PCA rotation maps each vector onto the
+ *                    eigenvectors of the sample covariance, largest
+ *                    eigenvalue first, at O(d^2) per vector. The Hadamard
+ *                    rotation flips the sign of each coordinate at random,
+ *                    pads to a power of two and applies the normalized
+ *                    Walsh-Hadamard transform, at O(d log d) per vector.
+ *                    Both keep distances, so the leaves hold the same
+ *                    neighbours a kd tree would find in that basis. The
+ *                    rotated vectors are doubles, so that integer data
+ *                    sets rotate without loss, and only live while the
+ *                    tree is built; routing needs the rotated query alone
+ *                    and the leaves hold ids of the data set.
+ * Data Field(s)    : kind_       - ROTATION_PCA or ROTATION_HADAMARD
+ *                    dimension_  - The dimension of the data set
+ *                    rotation_   - The PCA rotation, one row per axis
+ *                    seed_       - The seed of the Hadamard signs
+ *                    st_         - The data set associated with the tree
+ *                    empty_st_   - An empty set the kd tree is bound to once
+ *                                  built or loaded
+ *                    tree_       - The kd tree of the rotated data set
+ * Function(s)      : RotatedKDTree(size_t, bool, DataSet<Label, T> &)
+ *                          - Creates a tree of given min leaf size and data
+ *                            set, rotated by Hadamard if asked, PCA if not
+ *                    RotatedKDTree(ifstream &, DataSet<Label, T> &)
+ *                          - De-serialization
+ *                    ~RotatedKDTree()
+ *                          - Deconstructor
+ *                    DataSet<Label, T> & get_st() const
+ *                          - Returns the set associated with the tree
+ *                    KDTree<Label, double> & get_tree() const
+ *                          - Returns the kd tree of the rotated space
+ *                    vector<double> rotate(const vector<T> &) const
+ *                          - Rotates a vector
+ *                    void save(ofstream &) const
+ *                          - Serializes the tree
+ *                    vector<size_t> subdomain(vector<T> *, size_t) const
+ *                          - Queries the tree for a subdomain
+ */
+template<class Label, class T>
+class RotatedKDTree
+{
+private:
+    size_t kind_;
+    size_t dimension_;
+    Eigen::MatrixXd rotation_;
+    uint64_t seed_;
+    DataSet<Label, T> & st_;
+    DataSet<Label, double> empty_st_;
+    KDTree<Label, double> * tree_;
+    RotatedKDTree(const RotatedKDTree &);
+    RotatedKDTree & operator=(const RotatedKDTree &);
+public:
+    RotatedKDTree(size_t min_leaf_size, bool hadamard, DataSet<Label, T> & st);
+    RotatedKDTree(ifstream & in, DataSet<Label, T> & st);
+    ~RotatedKDTree();
+    DataSet<Label, T> & get_st() const
+    { return st_; }
+    KDTree<Label, double> & get_tree() const
+    { return *tree_; }
+    vector<double> rotate(const vector<T> & v) const;
+    void save(ofstream & out) const;
+    vector<size_t> subdomain(vector<T> * query, size_t l_c = 0) const;
+};
+
+/*
+ * Name             : hadamard_transform
+ * Prototype        : void hadamard_transform(vector<double> &)
+ * Description      : Applies the Walsh-Hadamard transform in place,
+ *                    normalized so that it is orthogonal.
+ * Parameter(s)     : v - The vector, of a power of two size
+ * Return Value     : None
+ */
+inline void hadamard_transform(vector<double> & v)
+{
+    size_t n = v.size();
+    for (size_t h = 1; h < n; h <<= 1) {
+        for (size_t i = 0; i < n; i += h << 1) {
+            for (size_t j = i; j < i + h; j++) {
+                double a = v[j];
+                double b = v[j + h];
+                v[j] = a + b;
+                v[j + h] = a - b;
+            }
+        }
+    }
+    double scale = 1. / sqrt((double)n);
+    for (size_t i = 0; i < n; i++)
+        v[i] *= scale;
+}
+
+/* Public Functions */
+
+template<class Label, class T>
+RotatedKDTree<Label, T>::RotatedKDTree(size_t min_leaf_size, bool hadamard,
+        DataSet<Label, T> & st) :
+  kind_ (hadamard ? ROTATION_HADAMARD : ROTATION_PCA),
+  dimension_ ((*st[0]).size()),
+  seed_ (0),
+  st_ (st),
+  tree_ (NULL)
+{
+    LOG_INFO("RotatedKDTree Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, hadamard = %d\n", min_leaf_size, (int)hadamard);
+    if (hadamard)
+        seed_ = random_tie_seed();
+    else {
+        Eigen::MatrixXd centered = sample_centered_rows(st, ROTATED_KD_PCA_SAMPLES);
+        Eigen::MatrixXd covar = (centered.adjoint() * centered) / (double)centered.rows();
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(covar);
+        rotation_ = eig.eigenvectors().rowwise().reverse().transpose();
+    }
+
+    //build on the rotated vectors, then keep only the nodes
+    typename DataSet<Label, double>::vector_space vectors;
+    for (size_t i = 0; i < st.size(); i++)
+        vectors.push_back(new vector<double>(rotate(*st[i])));
+    DataSet<Label, double> rotated_st (vectors);
+    LOG_FINE("> %ld vectors rotated\n", vectors.size());
+    KDTree<Label, double> built (min_leaf_size, rotated_st);
+    tree_ = new KDTree<Label, double>(empty_st_);
+    tree_->set_root(built.get_root());
+    built.set_root(NULL);
+}
+
+template<class Label, class T>
+RotatedKDTree<Label, T>::RotatedKDTree(ifstream & in, DataSet<Label, T> & st) :
+  seed_ (0),
+  st_ (st),
+  tree_ (NULL)
+{
+    LOG_INFO("RotatedKDTree Constructed\n");
+    LOG_FINE("with input stream\n");
+    in.read((char *)&kind_, sizeof(size_t));
+    in.read((char *)&dimension_, sizeof(size_t));
+    if (kind_ == ROTATION_HADAMARD)
+        in.read((char *)&seed_, sizeof(uint64_t));
+    else {
+        rotation_.resize(dimension_, dimension_);
+        in.read((char *)rotation_.data(), sizeof(double) * dimension_ * dimension_);
+    }
+    tree_ = new KDTree<Label, double>(in, empty_st_);
+}
+
+template<class Label, class T>
+RotatedKDTree<Label, T>::~RotatedKDTree()
+{
+    delete tree_;
+    LOG_INFO("RotatedKDTree Deconstructed\n");
+}
+
+/*
+ * Name             : rotate
+ * Prototype        : vector<double> rotate(const vector<T> &) const
+ * Description      : Rotates a vector into the space of the tree.
+ * Parameter(s)     : v - The vector
+ * Return Value     : The rotated vector, padded to a power of two size for
+ *                    the Hadamard rotation
+ */
+template<class Label, class T>
+vector<double> RotatedKDTree<Label, T>::rotate(const vector<T> & v) const
+{
+    if (kind_ == ROTATION_HADAMARD) {
+        size_t n = 1;
+        while (n < dimension_)
+            n <<= 1;
+        vector<double> result (n, 0.);
+        uint64_t state = seed_;
+        uint64_t bits = 0;
+        for (size_t i = 0; i < dimension_; i++) {
+            if (i % 64 == 0)
+                bits = splitmix64(state);
+            result[i] = (bits >> (i % 64)) & 1 ? -(double)v[i] : (double)v[i];
+        }
+        hadamard_transform(result);
+        return result;
+    }
+    Eigen::VectorXd x (dimension_);
+    for (size_t i = 0; i < dimension_; i++)
+        x(i) = (double)v[i];
+    Eigen::VectorXd y = rotation_ * x;
+    return vector<double>(y.data(), y.data() + dimension_);
+}
+
+template<class Label, class T>
+void RotatedKDTree<Label, T>::save(ofstream & out) const
+{
+    LOG_INFO("Saving RotatedKDTree\n");
+    out.write((char *)&kind_, sizeof(size_t));
+    out.write((char *)&dimension_, sizeof(size_t));
+    if (kind_ == ROTATION_HADAMARD)
+        out.write((char *)&seed_, sizeof(uint64_t));
+    else
+        out.write((char *)rotation_.data(), sizeof(double) * dimension_ * dimension_);
+    tree_->save(out);
+}
+
+template<class Label, class T>
+vector<size_t> RotatedKDTree<Label, T>::subdomain(vector<T> * query, size_t l_c) const
+{
+    vector<double> rotated = rotate(*query);
+    return tree_->subdomain(&rotated, l_c);
+}
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * File             : rp_forest.h
+ * Summary          : Builds a forest of RP or V^2 trees level by level. The
+ *                    split directions of one level of every tree are drawn
+ *                    together, and all points are projected on them with a
+ *                    single blocked matrix multiply instead of one dot
+ *                    product loop per node.
+ */
+#ifndef RP_FOREST_H_
+#define RP_FOREST_H_
+
+#include <algorithm>
+#include <random>
+#include "Eigen/Core"
+#include "vector_math.h"
+#include "rp_tree.h"
+using namespace std;
+
+/* Number of points copied into a matrix per block of the projection */
+#define RP_FOREST_BLOCK 4096
+
+/* Class Definitions */
+
+/*
+ * Name             : RPForestSplit
+ * Description      : A domain waiting for its node, and where that node is
+ *                    hung in its tree.
+ * Data Field(s)    : parent - The node to hang it off, NULL for the root
+ *                    left   - Whether it is the left child of parent
+ *                    domain - The domain of the node
+ */
+template<class Label, class T>
+struct RPForestSplit
+{
+    PCATreeNode<Label, T> * parent;
+    bool left;
+    vector<size_t> domain;
+};
+
+/*
+ * Name             : RPForest
+ * Description      : A set of RP trees, or V^2 trees, of one data set built
+ *                    together. All the nodes of one level of a tree share a
+ *                    split direction, so a level of the whole forest is a
+ *                    (points x dimension) by (dimension x trees) matrix
+ *                    product. Each node still splits at the median of the
+ *                    projections of its own domain.
+ * Data Field(s)    : trees_ - The trees of the forest
+ * Function(s)      : RPForest(size_t, size_t, bool, DataSet<Label, T> &)
+ *                          - Builds a forest of given min leaf size and
+ *                            number of trees, with V^2 directions if asked
+ *                    ~RPForest()
+ *                          - Deconstructor
+ *                    size_t size() const
+ *                          - Returns the number of trees
+ *                    RPTree<Label, T> & get_tree(size_t) const
+ *                          - Returns a tree of the forest
+ */
+template<class Label, class T>
+class RPForest
+{
+private:
+    vector<RPTree<Label, T> *> trees_;
+    RPForest(const RPForest &);
+    RPForest & operator=(const RPForest &);
+    static void project(DataSet<Label, T> & st, const Eigen::MatrixXd & dirs,
+            Eigen::MatrixXd & values);
+    static double split(const vector<size_t> & domain, const vector<double> & values,
+            vector<size_t> & subdomain_l, vector<size_t> & subdomain_r);
+public:
+    RPForest(size_t min_leaf_size, size_t tree_count, bool v2, DataSet<Label, T> & st);
+    ~RPForest();
+    size_t size() const
+    { return trees_.size(); }
+    RPTree<Label, T> & get_tree(size_t index) const
+    { return *trees_[index]; }
+};
+
+/* Private Functions */
+
+/*
+ * Name             : project
+ * Prototype        : void project(DataSet<Label, T> &, const Eigen::MatrixXd &,
+ *                                 Eigen::MatrixXd &)
+ * Description      : Projects every vector of the data set on every
+ *                    direction. The vectors are copied RP_FOREST_BLOCK rows
+ *                    at a time, so only one block is held as doubles.
+ * Parameter(s)     : st     - The data set
+ *                    dirs   - The directions, one per column
+ *                    values - Set to the projections, one row per vector
+ *                             and one column per direction
+ * Return Value     : None
+ */
+template<class Label, class T>
+void RPForest<Label, T>::project(DataSet<Label, T> & st, const Eigen::MatrixXd & dirs,
+        Eigen::MatrixXd & values)
+{
+    size_t count = st.size();
+    size_t dimension = dirs.rows();
+    values.resize(count, dirs.cols());
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> block;
+    for (size_t start = 0; start < count; start += RP_FOREST_BLOCK) {
+        size_t rows = min((size_t)RP_FOREST_BLOCK, count - start);
+        block.resize(rows, dimension);
+        for (size_t i = 0; i < rows; i++) {
+            const vector<T> & v = *st[start + i];
+            for (size_t j = 0; j < dimension; j++)
+                block(i, j) = (double)v[j];
+        }
+        values.middleRows(start, rows).noalias() = block * dirs;
+    }
+}
+
+/*
+ * Name             : split
+ * Prototype        : double split(const vector<size_t> &, const vector<double> &,
+ *                                 vector<size_t> &, vector<size_t> &)
+ * Description      : Splits a domain at the median of its projections the
+ *                    way RPTree does, handing the points at the pivot to
+ *                    the left child until it holds half of the domain. The
+ *                    median is the same value selector() would pick.
+ * Parameter(s)     : domain      - The domain to split
+ *                    values      - The projections of the domain
+ *                    subdomain_l - Set to the left half
+ *                    subdomain_r - Set to the right half
+ * Return Value     : The pivot
+ */
+template<class Label, class T>
+double RPForest<Label, T>::split(const vector<size_t> & domain, const vector<double> & values,
+        vector<size_t> & subdomain_l, vector<size_t> & subdomain_r)
+{
+    size_t subdomain_l_lim = (size_t)(values.size() * 0.5);
+    vector<double> ranked (values);
+    nth_element(ranked.begin(), ranked.begin() + (subdomain_l_lim - 1), ranked.end());
+    double pivot = ranked[subdomain_l_lim - 1];
+    vector<size_t> pivot_pool;
+    for (size_t i = 0; i < domain.size(); i++) {
+        if (pivot == values[i])
+            pivot_pool.push_back(domain[i]);
+        else if (pivot > values[i])
+            subdomain_l.push_back(domain[i]);
+        else
+            subdomain_r.push_back(domain[i]);
+    }
+    while (subdomain_l_lim > subdomain_l.size()) {
+        subdomain_l.push_back(pivot_pool.back());
+        pivot_pool.pop_back();
+    }
+    while (!pivot_pool.empty()) {
+        subdomain_r.push_back(pivot_pool.back());
+        pivot_pool.pop_back();
+    }
+    return pivot;
+}
+
+/* Public Functions */
+
+template<class Label, class T>
+RPForest<Label, T>::RPForest(size_t min_leaf_size, size_t tree_count, bool v2,
+        DataSet<Label, T> & st)
+{
+    LOG_INFO("RPForest Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, tree_count = %ld, v2 = %d\n",
+            min_leaf_size, tree_count, (int)v2);
+    size_t dimension = (*st[0]).size();
+    vector<vector<RPForestSplit<Label, T> > > pending(tree_count);
+    for (size_t t = 0; t < tree_count; t++) {
+        trees_.push_back(new RPTree<Label, T>(st));
+        RPForestSplit<Label, T> root = {NULL, false, st.get_domain()};
+        pending[t].push_back(root);
+    }
+    random_device rd;
+    default_random_engine generator(rd());
+    uniform_int_distribution<size_t> distribution(0, st.size() - 1);
+    Eigen::MatrixXd values;
+    size_t level = 0;
+    bool more = true;
+    while (more) {
+        bool splitting = false;
+        for (size_t t = 0; t < tree_count; t++)
+            for (size_t s = 0; s < pending[t].size(); s++)
+                splitting = splitting || pending[t][s].domain.size() >= min_leaf_size;
+
+        //Draw the direction of this level of every tree and project on all of them
+        vector<vector<double> > dirs(tree_count);
+        if (splitting) {
+            Eigen::MatrixXd dir_mtx (dimension, tree_count);
+            for (size_t t = 0; t < tree_count; t++) {
+                //V^2 takes two points of the node holding a random point
+                const vector<size_t> * domain = NULL;
+                if (v2) {
+                    size_t index = distribution(generator);
+                    for (size_t s = 0; s < pending[t].size(); s++) {
+                        const vector<size_t> & d = pending[t][s].domain;
+                        if (d.size() < min_leaf_size || d.size() < 2)
+                            continue;
+                        bool holds = find(d.begin(), d.end(), index) != d.end();
+                        if (!domain || holds)
+                            domain = &d;
+                        if (holds)
+                            break;
+                    }
+                }
+                if (domain) {
+                    uniform_int_distribution<size_t> pick(0, domain->size() - 1);
+                    size_t index_i = pick(generator);
+                    size_t index_j = pick(generator);
+                    while (index_i == index_j)
+                        index_j = pick(generator);
+                    dirs[t] = random_diff(dimension, *st[(*domain)[index_i]], *st[(*domain)[index_j]]);
+                }
+                else
+                    dirs[t] = random_tie_breaker(dimension);
+                for (size_t j = 0; j < dimension; j++)
+                    dir_mtx(j, t) = dirs[t][j];
+            }
+            project(st, dir_mtx, values);
+            LOG_FINE("> level %ld projected\n", level);
+        }
+
+        more = false;
+        vector<vector<RPForestSplit<Label, T> > > next(tree_count);
+        for (size_t t = 0; t < tree_count; t++) {
+            for (size_t s = 0; s < pending[t].size(); s++) {
+                RPForestSplit<Label, T> & cur = pending[t][s];
+                PCATreeNode<Label, T> * node;
+                if (cur.domain.size() < min_leaf_size)
+                    node = new PCATreeNode<Label, T>(cur.domain);
+                else {
+                    vector<double> projections(cur.domain.size());
+                    for (size_t i = 0; i < cur.domain.size(); i++)
+                        projections[i] = values(cur.domain[i], t);
+                    RPForestSplit<Label, T> l = {NULL, true, vector<size_t>()};
+                    RPForestSplit<Label, T> r = {NULL, false, vector<size_t>()};
+                    double pivot = split(cur.domain, projections, l.domain, r.domain);
+                    node = new PCATreeNode<Label, T>(dirs[t], pivot, cur.domain);
+                    l.parent = r.parent = node;
+                    next[t].push_back(l);
+                    next[t].push_back(r);
+                    more = true;
+                }
+                if (!cur.parent)
+                    trees_[t]->set_root(node);
+                else if (cur.left)
+                    cur.parent->set_left(node);
+                else
+                    cur.parent->set_right(node);
+            }
+        }
+        pending.swap(next);
+        level++;
+    }
+    LOG_FINE("> %ld levels\n", level);
+}
+
+template<class Label, class T>
+RPForest<Label, T>::~RPForest()
+{
+    for (size_t t = 0; t < trees_.size(); t++)
+        delete trees_[t];
+    LOG_INFO("RPForest Deconstructed\n");
+}
+
+#endif
@@ -23,6 +23,13 @@ class RPTree;
  *                    RPTree(size_t, DataSet<Label, T>)
  *                          - Creates a tree of given min leaf size and
  *                            data set
+ *                    RPTree(size_t, bool, DataSet<Label, T>)
+ *                          - Creates a tree of given min leaf size whose
+ *                            directions are very sparse if asked, so a
+ *                            projection costs O(sqrt(d)) instead of O(d)
+ *                    RPTree(size_t, SplitRule, DataSet<Label, T>)
+ *                          - Creates a tree of given min leaf size whose
+ *                            nodes split by the given rule
  *                    RPTree(ifstream &, DataSet<Label, T>)
  *                          - De-serialization 
  */
@@ -31,17 +38,20 @@ class RPTree : public PCATree<Label, T>
 {
 private:
     static PCATreeNode<Label, T> * build_tree(size_t c,
-            DataSet<Label, T> & st, vector<size_t> domain);
+            DataSet<Label, T> & st, vector<size_t> domain, bool sparse = false,
+            SplitRule rule = SPLIT_MEDIAN);
 
 public:
     RPTree(DataSet<Label, T> & st);
     RPTree(size_t min_leaf_size, DataSet<Label, T> & st);
+    RPTree(size_t min_leaf_size, bool sparse, DataSet<Label, T> & st);
+    RPTree(size_t min_leaf_size, SplitRule rule, DataSet<Label, T> & st);
     RPTree(ifstream & in, DataSet<Label, T> & st);
 };
 
 template<class Label, class T>
 PCATreeNode<Label, T> * RPTree<Label, T>::build_tree(size_t min_leaf_size,
-        DataSet<Label, T> & st, vector<size_t> domain)
+        DataSet<Label, T> & st, vector<size_t> domain, bool sparse, SplitRule rule)
 {
     LOG_FINE("Enter build_tree\n");
     LOG_FINE("with min_leaf_size = %ld and domain.size = %ld\n", min_leaf_size, domain.size());
@@ -52,19 +62,30 @@ PCATreeNode<Label, T> * RPTree<Label, T>::build_tree(size_t min_leaf_size,
     }
     DataSet<Label, T> subst = st.subset(domain);
 
-    //Find a random vector
+    //Find a random vector, dense or very sparse
     size_t dimension = (*subst[0]).size();
-    vector<double> split_dir = random_tie_breaker(dimension);
+    vector<double> split_dir;
+    vector<uint32_t> sparse_dir;
+    if (sparse)
+        sparse_dir = random_sparse_direction(dimension);
+    else
+        split_dir = random_tie_breaker(dimension);
     
     vector<double> values;
     for (size_t i = 0; i < subst.size(); i++) {
-        double product = dot(*subst[i], split_dir);
+        double product = sparse ? sparse_dot(*subst[i], sparse_dir) : dot(*subst[i], split_dir);
         values.push_back(product);
     }
     
-    double pivot = selector(values, (size_t)(values.size() * 0.5));
+    double pivot;
+    size_t subdomain_l_lim;
+    if (rule == SPLIT_TWO_MEANS && !sparse)
+        pivot = two_means_pivot(subst, split_dir, values, subdomain_l_lim);
+    else {
+        pivot = selector(values, (size_t)(values.size() * 0.5));
+        subdomain_l_lim = (size_t)(values.size() * 0.5);
+    }
     vector<size_t> subdomain_l;
-    size_t subdomain_l_lim = (size_t)(values.size() * 0.5);
     LOG_FINE("> l_lim = %ld\n", subdomain_l_lim);
     vector<size_t> subdomain_r; 
     vector<size_t> pivot_pool;
@@ -89,10 +110,13 @@ PCATreeNode<Label, T> * RPTree<Label, T>::build_tree(size_t min_leaf_size,
         pivot_pool.pop_back();
         subdomain_r.push_back(curr);
     }
-    PCATreeNode<Label, T> * result = new PCATreeNode<Label, T>(split_dir, 
-            pivot, domain);
-    result->set_left(build_tree(min_leaf_size, st, subdomain_l));
-    result->set_right(build_tree(min_leaf_size, st, subdomain_r));
+    PCATreeNode<Label, T> * result;
+    if (sparse)
+        result = new PCATreeNode<Label, T>(sparse_dir, dimension, pivot, domain);
+    else
+        result = new PCATreeNode<Label, T>(split_dir, pivot, domain);
+    result->set_left(build_tree(min_leaf_size, st, subdomain_l, sparse, rule));
+    result->set_right(build_tree(min_leaf_size, st, subdomain_r, sparse, rule));
     LOG_FINE("> sdl = %ld\n", subdomain_l.size());
     LOG_FINE("> sdr = %ld\n", subdomain_r.size());
     LOG_FINE("Exit build_tree\n");
@@ -116,6 +140,24 @@ RPTree<Label, T>::RPTree(size_t min_leaf_size, DataSet<Label, T> & st) :
     this->set_root(build_tree(min_leaf_size, st, st.get_domain()));
 }
 
+template<class Label, class T>
+RPTree<Label, T>::RPTree(size_t min_leaf_size, bool sparse, DataSet<Label, T> & st) :
+    PCATree<Label, T>(st)
+{
+    LOG_INFO("RPTree Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, sparse = %d", min_leaf_size, (int)sparse);
+    this->set_root(build_tree(min_leaf_size, st, st.get_domain(), sparse));
+}
+
+template<class Label, class T>
+RPTree<Label, T>::RPTree(size_t min_leaf_size, SplitRule rule, DataSet<Label, T> & st) :
+    PCATree<Label, T>(st)
+{
+    LOG_INFO("RPTree Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, rule = %d", min_leaf_size, (int)rule);
+    this->set_root(build_tree(min_leaf_size, st, st.get_domain(), false, rule));
+}
+
 template<class Label, class T>
 RPTree<Label, T>::RPTree(ifstream & in, DataSet<Label, T> & st) :
     PCATree<Label, T>(in, st)
@@ -6,6 +6,8 @@
 #define TEST_H_
 
 #include <map>
+#include <mutex>
+#include <chrono>
 #include <thread>
 #include <fstream>
 #include <sstream>
@@ -15,13 +17,19 @@
 #include "data_set.h"
 #include "kd_tree.h"
 #include "n_spill_tree.h"
+#include "pn_spill_tree.h"
 #include "rkd_tree.h"
+#include "rotated_kd_tree.h"
 #include "kd_spill_tree.h"
 #include "kd_virtual_spill_tree.h"
+#include "kd_skeleton.h"
 #include "pca_tree.h"
 #include "rp_tree.h"
 #include "pca_spill_tree.h"
 #include "v2_tree.h"
+#include "rp_forest.h"
+#include "forest.h"
+#include "flat_tree.h"
 #include "nn.h"
 using namespace std;
 
@@ -43,6 +51,12 @@ static double min_leaf = 0.0001;// 0.001;
 static double a_array[]		= {0.05, 0.1};
 const size_t a_array_len	= 2;
 const size_t splits			= 3;
+const size_t pn_splits		= 8;
+static double max_blowup	= 3.0;
+static double vote_array[]	= {0.1, 0.25, 0.5};
+const size_t vote_array_len	= 3;
+static double probe_array[]	= {1, 2, 4};
+const size_t probe_array_len	= 3;
 const size_t leaf_size_array_len = 10;
 static double leaf_size_array[] = { 0.001, 0.002, 0.004, 0.006, 0.008, 0.01, 0.015, 0.02, 0.03, 0.05 };
 //{0.001, 0.002, 0.004, 0.006, 0.008, 0.01, 0.015, 0.02, 0.03, 0.05};
@@ -58,11 +72,31 @@ protected:
     DataSet<Label, T> * trn_st_;
     DataSet<Label, T> * tst_st_;
     map<vector<T> *, vector<size_t>> nn_mp_;
+    KDSkeleton<Label, T> * kd_skeleton_;
+    mutex kd_skeleton_mutex_;
 public:
     Test(string base_dir);
     Test(string base_dir, double c);
     ~Test();
 
+    /*
+     * The kd partition and the spill bands of every a_array factor are
+     * computed once and shared by the kd and kd virtual spill builds of the
+     * same min leaf size. Spill trees split their spilled domains on their
+     * own statistics, so they are built directly.
+     */
+    KDSkeleton<Label, T> & kd_skeleton(double min_leaf_size) {
+        lock_guard<mutex> lock (kd_skeleton_mutex_);
+        size_t leaf_size = (size_t)(min_leaf_size * (*trn_st_).size());
+        if (!kd_skeleton_ || kd_skeleton_->get_min_leaf_size() != leaf_size) {
+            LOG_INFO("Building kd skeleton.\n");
+            delete kd_skeleton_;
+            kd_skeleton_ = new KDSkeleton<Label, T>(leaf_size, a_array, a_array_len, *trn_st_);
+            LOG_INFO("Done building kd skeleton.\n");
+        }
+        return *kd_skeleton_;
+    }
+
     void s_kd_tree(double min_leaf_size) {
 		LOG_INFO("Building kd tree.\n");
         stringstream dir; 
@@ -71,14 +105,18 @@ public:
 		if (kd_tree_file.good()) {
 			LOG_INFO("File kd_tree found!!!\n");
 			kd_tree_file.clear();
+			s_flat_tree<KDTree<Label, T> >(dir.str());
 		}
 		else {
-			KDTree<Label, T> tree((size_t)(min_leaf_size * (*trn_st_).size()), *trn_st_);
+			const KDTree<Label, T> & tree = kd_skeleton(min_leaf_size).get_tree();
 			LOG_INFO("Done building kd tree.\n");
 			LOG_INFO("Writing kd tree.\n");
 			ofstream tree_out(dir.str(), ios::binary);
 			tree.save(tree_out);
 			tree_out.close();
+			ofstream flat_out(dir.str() + ".flat", ios::binary);
+			save_flat_tree(tree, flat_out);
+			flat_out.close();
 			LOG_INFO("Done writing kd tree.\n");
 		}
     }
@@ -87,6 +125,28 @@ public:
         s_kd_tree(min_leaf);
     }
     
+    void s_rotated_kd_tree(double min_leaf_size, bool hadamard) {
+		LOG_INFO("Building rotated kd tree.\n");
+        stringstream dir;
+        dir << base_dir_ << (hadamard ? "/hadamard_kd_tree_" : "/pca_kd_tree_") << setprecision(2) << min_leaf_size;
+		ifstream tree_file(dir.str(), ios::binary);
+		if (tree_file.good()) {
+			LOG_INFO("File rotated kd tree found!!!\n");
+			return;
+		}
+        RotatedKDTree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), hadamard, *trn_st_);
+		LOG_INFO("Done building rotated kd tree.\n");
+		LOG_INFO("Writing rotated kd tree.\n");
+        ofstream tree_out (dir.str(), ios::binary);
+        tree.save(tree_out);
+        tree_out.close();
+		LOG_INFO("Done writing rotated kd tree.\n");
+    }
+
+    void generate_rotated_kd_trees(bool hadamard) {
+        s_rotated_kd_tree(min_leaf, hadamard);
+    }
+
     void s_n_spill_tree(double min_leaf_size, double a_value, int num_splits) {
 		LOG_INFO("Building n spill tree.\n");
         stringstream dir;
@@ -109,25 +169,85 @@ public:
             t[i].join();
         }
     }
+
+    string pn_spill_tree_path(double min_leaf_size, double a_value, bool random_dir) {
+        stringstream dir;
+        dir << base_dir_ << (random_dir ? "/rp_" : "/pca_") << pn_splits << "_spill_tree_"
+            << setprecision(2) << a_value << "_" << min_leaf_size;
+        return dir.str();
+    }
+
+    void s_pn_spill_tree(double min_leaf_size, double a_value, bool random_dir) {
+		LOG_INFO("Building projected n spill tree.\n");
+        PNSpillTree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), pn_splits,
+                a_value, random_dir, *trn_st_);
+		LOG_INFO("Done building projected n spill tree.\n");
+		LOG_INFO("Writing projected n spill tree.\n");
+        ofstream tree_out (pn_spill_tree_path(min_leaf_size, a_value, random_dir), ios::binary);
+        tree.save(tree_out);
+        tree_out.close();
+		LOG_INFO("Done building projected n spill tree.\n");
+    }
+
+    void generate_pn_spill_trees(bool random_dir) {
+        thread t [a_array_len];
+        for (size_t i = 0; i < a_array_len; i++) {
+            t[i] = thread(&Test<Label, T>::s_pn_spill_tree, this, min_leaf, a_array[i], random_dir);
+        }
+        for (size_t i = 0; i < a_array_len; i++) {
+            t[i].join();
+        }
+    }
     
+    /*
+     * The rkd, rp and v2 trees of a min leaf size are saved together as
+     * one forest bundle.
+     */
+    string forest_path(const string & tree_name, double min_leaf_size) const
+    {
+        stringstream dir;
+        dir << base_dir_ << "/" << tree_name << "_forest_" << setprecision(2) << min_leaf_size;
+        return dir.str();
+    }
+
+    bool forest_found(const string & path, int n) const
+    {
+        ifstream forest_file (path, ios::binary);
+        uint64_t header [2] = {0, 0};
+        forest_file.read((char *)header, sizeof(header));
+        return forest_file.good() && header[0] == FOREST_MAGIC && header[1] >= (uint64_t)n;
+    }
+
+    /*
+     * Trees split by two-means are saved and reported under their own
+     * names, next to the median split ones.
+     */
+    string rp_name(bool sparse, SplitRule rule) const
+    {
+        return sparse ? "sparse_rp" : (rule == SPLIT_TWO_MEANS ? "rp_2means" : "rp");
+    }
+
+    string v2_name(SplitRule rule) const
+    {
+        return rule == SPLIT_TWO_MEANS ? "v2_2means" : "v2";
+    }
+
+    string pca_name(SplitRule rule) const
+    {
+        return rule == SPLIT_TWO_MEANS ? "pca_2means" : "pca";
+    }
+
     void s_rkd_tree(double min_leaf_size, int n) {
 		LOG_INFO("Building rkd trees.\n");
-        stringstream dir;
-        for (int i=1; i<=n; i++) {
-			LOG_INFO("Building rkd tree %d.\n", i);
-            dir << base_dir_ << "/rkd_tree" << i << "_" << setprecision(2) << min_leaf_size;
-            ifstream rkd_tree_file (dir.str(), ios::binary);
-            if (rkd_tree_file.good()) {
-                LOG_INFO("File rkd_tree%d found!!!\n", i);
-                rkd_tree_file.clear();
-            }
-            else {
-                RKDTree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), *trn_st_);
-                ofstream tree_out (dir.str(), ios::binary);
-                tree.save(tree_out);
-                tree_out.close();
-            }
-            dir.str("");
+        string path = forest_path("rkd", min_leaf_size);
+        if (forest_found(path, n)) {
+            LOG_INFO("File %s found!!!\n", path.c_str());
+        }
+        else {
+            Forest<RKDTree<Label, T> > forest (n, *trn_st_, (size_t)(min_leaf_size * (*trn_st_).size()));
+            ofstream forest_out (path, ios::binary);
+            forest.save(forest_out);
+            forest_out.close();
         }
 		LOG_INFO("Done building rkd trees.\n");
     }
@@ -136,49 +256,82 @@ public:
         s_rkd_tree(min_leaf, rkd_tree[rkd_tree_len-1]);
     }
     
-    void s_v2_tree(double min_leaf_size, int n) {
+    void s_v2_tree(double min_leaf_size, int n, SplitRule rule = SPLIT_MEDIAN) {
 		LOG_INFO("Building v2 trees.\n");
-        stringstream dir;
-        for (int i=1; i<=n; i++) {
-			LOG_INFO("Building v2 tree %d.\n", i);
-            dir << base_dir_ << "/v2_tree" << i << "_" << setprecision(2) << min_leaf_size;
-            ifstream v2_tree_file (dir.str(), ios::binary);
-            if (v2_tree_file.good()) {
-                LOG_INFO("File v2_tree%d found!!!\n", i);
-                v2_tree_file.clear();
-            }
-            else {
-                V2Tree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), *trn_st_);
-                ofstream tree_out (dir.str(), ios::binary);
-                tree.save(tree_out);
-                tree_out.close();
-            }
-            dir.str("");
+        string path = forest_path(v2_name(rule), min_leaf_size);
+        if (forest_found(path, n)) {
+            LOG_INFO("File %s found!!!\n", path.c_str());
+        }
+        else {
+            Forest<V2Tree<Label, T> > forest (n, *trn_st_, (size_t)(min_leaf_size * (*trn_st_).size()), rule);
+            ofstream forest_out (path, ios::binary);
+            forest.save(forest_out);
+            forest_out.close();
         }
 		LOG_INFO("Done building v2 trees.\n");
     }
     
-    void generate_v2_trees() {
-        s_v2_tree(min_leaf, v2_tree[v2_tree_len-1]);
+    void generate_v2_trees(SplitRule rule = SPLIT_MEDIAN) {
+        s_v2_tree(min_leaf, v2_tree[v2_tree_len-1], rule);
+    }
+
+    /*
+     * Builds the rp or v2 trees together as one RPForest. Its levels share
+     * a direction, so it is saved under its own name (rp_level, v2_level)
+     * and never mistaken for the rp and v2 bundles. Nothing is built when
+     * the bundle is found.
+     */
+    void s_rp_forest(double min_leaf_size, int n, bool v2)
+    {
+		LOG_INFO("Building %s forest.\n", v2 ? "v2" : "rp");
+        string path = forest_path(v2 ? "v2_level" : "rp_level", min_leaf_size);
+        if (forest_found(path, n)) {
+            LOG_INFO("File %s found!!!\n", path.c_str());
+            return;
+        }
+        RPForest<Label, T> forest ((size_t)(min_leaf_size * (*trn_st_).size()), n, v2, *trn_st_);
+        vector<const RPTree<Label, T> *> trees;
+        for (int i=0; i<n; i++)
+            trees.push_back(&forest.get_tree(i));
+        ofstream forest_out (path, ios::binary);
+        save_tree_bundle(trees, forest_out);
+        forest_out.close();
+		LOG_INFO("Done building %s forest.\n", v2 ? "v2" : "rp");
+    }
+
+    void generate_rp_forest(bool v2 = false)
+    {
+        s_rp_forest(min_leaf, v2 ? v2_tree[v2_tree_len-1] : rp_tree[rp_tree_len-1], v2);
     }
 
-    void s_kd_spill_tree(double min_leaf_size, double a_value) {
+    void s_kd_spill_tree(double min_leaf_size, double a_value, bool budgeted) {
 		LOG_INFO("Building kd spill tree.\n");
         stringstream dir; 
-        dir << base_dir_ << "/kd_spill_tree_" << setprecision(3) << a_value << "_" << min_leaf_size;
-        KDSpillTree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), a_value, *trn_st_);
+        dir << base_dir_ << (budgeted ? "/kd_spill_budget_tree_" : "/kd_spill_tree_")
+            << setprecision(3) << a_value << "_" << min_leaf_size;
+        KDSpillTree<Label, T> * tree;
+        if (budgeted)
+            tree = new KDSpillTree<Label, T>((size_t)(min_leaf_size * (*trn_st_).size()),
+                    a_value, max_blowup, *trn_st_);
+        else
+            tree = new KDSpillTree<Label, T>((size_t)(min_leaf_size * (*trn_st_).size()),
+                    a_value, *trn_st_);
 		LOG_INFO("Done building kd spill tree.\n");
 		LOG_INFO("Writing kd spill tree.\n");
         ofstream tree_out (dir.str(), ios::binary);
-        tree.save(tree_out);
+        tree->save(tree_out);
         tree_out.close();
+        ofstream flat_out (dir.str() + ".flat", ios::binary);
+        save_flat_tree(*tree, flat_out);
+        flat_out.close();
+        delete tree;
 		LOG_INFO("Done building kd spill tree.\n");
     }
 
-    void generate_kd_spill_trees() {
+    void generate_kd_spill_trees(bool budgeted = false) {
         thread t [a_array_len];
         for (size_t i = 0; i < a_array_len; i++) {
-            t[i] = thread(&Test<Label, T>::s_kd_spill_tree, this, min_leaf, a_array[i]);
+            t[i] = thread(&Test<Label, T>::s_kd_spill_tree, this, min_leaf, a_array[i], budgeted);
         }
         for (size_t i = 0; i < a_array_len; i++) {
             t[i].join();
@@ -190,7 +343,7 @@ public:
 		LOG_INFO("Building kd virtual spill tree.\n");
         stringstream dir; 
         dir << base_dir_ << "/kd_v_spill_tree_" << setprecision(2) << a_value << "_" << min_leaf_size;
-        KDVirtualSpillTree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), a_value, *trn_st_);
+        KDVirtualSpillTree<Label, T> tree (kd_skeleton(min_leaf_size), a_value, *trn_st_);
 		LOG_INFO("Done building kd virtual spill tree.\n");
 		LOG_INFO("Writing kd virtual spill tree.\n");
         ofstream tree_out (dir.str(), ios::binary);
@@ -199,6 +352,42 @@ public:
 		LOG_INFO("Done building kd virtual spill tree.\n");
     }
 
+    /*
+     * Writes the range side-cars of the saved kd tree for every a_array
+     * factor in one pass over its nodes, instead of building a virtual
+     * spill tree per factor.
+     */
+    void s_kd_v_spill_ranges(double min_leaf_size)
+    {
+		LOG_INFO("Building kd virtual spill ranges.\n");
+        s_kd_tree(min_leaf_size);
+        stringstream dir;
+        dir << base_dir_ << "/kd_tree_" << setprecision(2) << min_leaf_size;
+        ifstream tree_in (dir.str(), ios::binary);
+        KDTree<Label, T> tree (tree_in, *trn_st_);
+        tree_in.close();
+        ofstream range_out [a_array_len];
+        for (size_t i = 0; i < a_array_len; i++)
+            range_out[i].open(kd_v_spill_range_path(min_leaf_size, a_array[i]), ios::binary);
+        if (!KDVirtualSpillTree<Label, T>::save_ranges(tree, a_array, a_array_len, range_out))
+            LOG_ERROR("Failed writing kd virtual spill ranges.\n");
+        for (size_t i = 0; i < a_array_len; i++)
+            range_out[i].close();
+		LOG_INFO("Done writing kd virtual spill ranges.\n");
+    }
+
+    void generate_kd_v_spill_ranges()
+    {
+        s_kd_v_spill_ranges(min_leaf);
+    }
+
+    string kd_v_spill_range_path(double min_leaf_size, double a_value)
+    {
+        stringstream dir;
+        dir << base_dir_ << "/kd_tree_" << setprecision(2) << min_leaf_size << ".range_" << a_value;
+        return dir.str();
+    }
+
     void generate_kd_v_spill_trees()
     {
         thread t [a_array_len];
@@ -210,94 +399,148 @@ public:
         }
     }
     
-    void s_rp_tree(double min_leaf_size, int n)
+    void s_rp_tree(double min_leaf_size, int n, bool sparse, SplitRule rule = SPLIT_MEDIAN)
     {
 		LOG_INFO("Building rp trees.\n");
-        stringstream dir;
-        for (int i=1; i<=n; i++) {
-			LOG_INFO("Building rp tree %d.\n", i);
-            dir << base_dir_ << "/rp_tree_" << i << "_" << setprecision(2) << min_leaf_size;
-            ifstream rp_tree_file (dir.str(), ios::binary);
-            if (rp_tree_file.good()) {
-                LOG_INFO("File rp_tree%d found!!!\n", i);
-                rp_tree_file.clear();
-            }
-            else {
-                RPTree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), *trn_st_);
-                ofstream tree_out (dir.str(), ios::binary);
-                tree.save(tree_out);
-                tree_out.close();
-            }
-            dir.str("");
+        string path = forest_path(rp_name(sparse, rule), min_leaf_size);
+        if (forest_found(path, n)) {
+            LOG_INFO("File %s found!!!\n", path.c_str());
+        }
+        else {
+            size_t leaf_size = (size_t)(min_leaf_size * (*trn_st_).size());
+            Forest<RPTree<Label, T> > * forest;
+            if (sparse)
+                forest = new Forest<RPTree<Label, T> >(n, *trn_st_, leaf_size, sparse);
+            else
+                forest = new Forest<RPTree<Label, T> >(n, *trn_st_, leaf_size, rule);
+            ofstream forest_out (path, ios::binary);
+            forest->save(forest_out);
+            forest_out.close();
+            delete forest;
         }
 		LOG_INFO("Done building rp trees.\n");
-            
     }
     
-    void generate_rp_trees()
+    void generate_rp_trees(bool sparse = false, SplitRule rule = SPLIT_MEDIAN)
     {
-        s_rp_tree(min_leaf, rp_tree[rp_tree_len-1]);
+        s_rp_tree(min_leaf, rp_tree[rp_tree_len-1], sparse, rule);
     }
 
 
-    void s_pca_tree(double min_leaf_size)
+    void s_pca_tree(double min_leaf_size, SplitRule rule = SPLIT_MEDIAN)
     {
 		LOG_INFO("Building pca tree.\n");
         stringstream dir; 
-        dir << base_dir_ << "/pca_tree_" << setprecision(2) << min_leaf_size;
+        dir << base_dir_ << "/" << pca_name(rule) << "_tree_" << setprecision(2) << min_leaf_size;
 		ifstream pca_tree_file(dir.str(), ios::binary);
 		if (pca_tree_file.good()) {
 			LOG_INFO("File pca_tree found!!!\n");
 			pca_tree_file.clear();
+			s_flat_tree<PCATree<Label, T> >(dir.str());
 		}
 		else {
-			PCATree<Label, T> tree((size_t)(min_leaf_size * (*trn_st_).size()), *trn_st_);
+			PCATree<Label, T> tree((size_t)(min_leaf_size * (*trn_st_).size()), rule, *trn_st_);
 			LOG_INFO("Done building pca tree.\n");
 			LOG_INFO("Writing pca tree.\n");
 			ofstream tree_out(dir.str(), ios::binary);
 			tree.save(tree_out);
 			tree_out.close();
+			ofstream flat_out(dir.str() + ".flat", ios::binary);
+			save_flat_tree(tree, flat_out);
+			flat_out.close();
 			LOG_INFO("Done building pca tree.\n");
 		}
     }
 
-    void generate_pca_trees()
+    void generate_pca_trees(SplitRule rule = SPLIT_MEDIAN)
     {
-        s_pca_tree(min_leaf);
+        s_pca_tree(min_leaf, rule);
     }
 
-    void s_pca_spill_tree(double min_leaf_size, double a_value)
+    void s_pca_spill_tree(double min_leaf_size, double a_value, bool budgeted)
     {
 		LOG_INFO("Building pca spill tree.\n");
         stringstream dir; 
-        dir << base_dir_ << "/pca_spill_tree_" << setprecision(2) << a_value << "_" << min_leaf_size;
-        PCASpillTree<Label, T> tree ((size_t)(min_leaf_size * (*trn_st_).size()), a_value, *trn_st_);
+        dir << base_dir_ << (budgeted ? "/pca_spill_budget_tree_" : "/pca_spill_tree_")
+            << setprecision(2) << a_value << "_" << min_leaf_size;
+        PCASpillTree<Label, T> * tree;
+        if (budgeted)
+            tree = new PCASpillTree<Label, T>((size_t)(min_leaf_size * (*trn_st_).size()),
+                    a_value, max_blowup, *trn_st_);
+        else
+            tree = new PCASpillTree<Label, T>((size_t)(min_leaf_size * (*trn_st_).size()),
+                    a_value, *trn_st_);
 		LOG_INFO("Done building pca spill tree.\n");
 		LOG_INFO("Writing pca spill tree.\n");
         ofstream tree_out (dir.str(), ios::binary);
-        tree.save(tree_out);
+        tree->save(tree_out);
         tree_out.close();
+        ofstream flat_out (dir.str() + ".flat", ios::binary);
+        save_flat_tree(*tree, flat_out);
+        flat_out.close();
+        delete tree;
 		LOG_INFO("Done building pca spill tree.\n");
     }
 
-    void generate_pca_spill_trees()
+    void generate_pca_spill_trees(bool budgeted = false)
     {
         thread t [a_array_len];
         for (size_t i = 0; i < a_array_len; i++) {
-            t[i] = thread(&Test<Label, T>::s_pca_spill_tree, this, min_leaf, a_array[i]);
+            t[i] = thread(&Test<Label, T>::s_pca_spill_tree, this, min_leaf, a_array[i], budgeted);
         }
         for (size_t i = 0; i < a_array_len; i++) {
             t[i].join();
         }
     }
 
+    template<class Tree>
+    void s_flat_tree(const string & tree_path)
+    {
+        string flat_path = tree_path + ".flat";
+        if (flat_tree_current(flat_path)) {
+            LOG_INFO("File %s found!!!\n", flat_path.c_str());
+            return;
+        }
+        ifstream tree_file (tree_path, ios::binary);
+        if (!tree_file.good()) {
+            LOG_WARNING("File %s not found!!!\n", tree_path.c_str());
+            return;
+        }
+        tree_file.close();
+        LOG_INFO("Flattening %s.\n", tree_path.c_str());
+        convert_flat_tree<Tree>(tree_path, flat_path, *trn_st_);
+    }
+
+    void flatten_trees()
+    {
+        LOG_INFO("Flattening trees.\n");
+        stringstream dir;
+        dir << base_dir_ << "/kd_tree_" << setprecision(2) << min_leaf;
+        s_flat_tree<KDTree<Label, T> >(dir.str());
+        dir.str("");
+        dir << base_dir_ << "/pca_tree_" << setprecision(2) << min_leaf;
+        s_flat_tree<PCATree<Label, T> >(dir.str());
+        for (size_t i = 0; i < a_array_len; i++) {
+            dir.str("");
+            dir << base_dir_ << "/kd_spill_tree_" << setprecision(2) << a_array[i] << "_" << min_leaf;
+            s_flat_tree<KDSpillTree<Label, T> >(dir.str());
+            dir.str("");
+            dir << base_dir_ << "/pca_spill_tree_" << setprecision(2) << a_array[i] << "_" << min_leaf;
+            s_flat_tree<PCASpillTree<Label, T> >(dir.str());
+        }
+        LOG_INFO("Done flattening trees.\n");
+    }
+
     void s_kd_tree_data(double leaf_size, string * result)
     {
 		LOG_INFO("Running kd tree test of size %ld.\n", (*tst_st_).size());
         stringstream dir; 
         dir << base_dir_ << "/kd_tree_" << setprecision(2) << min_leaf;
-        ifstream tree_in (dir.str(), ios::binary);
-        KDTree<Label, T> tree (tree_in, *trn_st_);
+        FlatTree<Label, T> tree (dir.str() + ".flat", *trn_st_);
+        if (!tree.good()) {
+            LOG_ERROR("No flat tree at %s.flat, run flatten first\n", dir.str().c_str());
+            return;
+        }
         size_t error_count = 0;
         size_t true_nn_count = 0;
         unsigned long long subdomain_count = 0;
@@ -351,6 +594,70 @@ public:
         dat_out.close();
     }
     
+    /*
+     * The query is rotated once, then descends the kd tree of the rotated
+     * space; the leaf holds indices of the training set itself.
+     */
+    void s_rotated_kd_tree_data(const RotatedKDTree<Label, T> * tree, double leaf_size, string * result)
+    {
+		LOG_INFO("Running rotated kd tree test of size %ld.\n", (*tst_st_).size());
+        size_t error_count = 0;
+        size_t true_nn_count = 0;
+        unsigned long long subdomain_count = 0;
+        for (size_t i = 0; i < (*tst_st_).size(); i++) {
+            DataSet<Label, T> subSet = (*trn_st_).subset(tree->subdomain((*tst_st_)[i], (size_t)(leaf_size * (*trn_st_).size())));
+            vector<T> * nn_vtr = nearest_neighbor((*tst_st_)[i], subSet);
+            Label nn_lbl = (*trn_st_).get_label(nn_vtr);
+            if (nn_lbl != (*tst_st_).get_label(i))
+                error_count++;
+			for (int k = 0; k < nn_mp_[(*tst_st_)[i]].size(); k++) {
+				if (nn_vtr == (*trn_st_)[nn_mp_[(*tst_st_)[i]][k]]) {
+					true_nn_count++;
+					break;
+				}
+			}
+            subdomain_count += subSet.size();
+        }
+        stringstream data;
+        data <<  setw(COL_W) <<  leaf_size;
+        data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (subdomain_count * 1. / (*tst_st_).size());
+        data << endl;
+        *result = data.str();
+		LOG_INFO("Done rotated kd tree test.\n");
+    }
+
+    void generate_rotated_kd_tree_data(string out_dir, bool hadamard)
+    {
+        string name = hadamard ? "hadamard_kd_tree" : "pca_kd_tree";
+        stringstream dir;
+        dir << base_dir_ << "/" << name << "_" << setprecision(2) << min_leaf;
+        ifstream tree_in (dir.str(), ios::binary);
+        if (!tree_in.good()) {
+            LOG_WARNING("No %s found!!!\n", name.c_str());
+            return;
+        }
+        RotatedKDTree<Label, T> tree (tree_in, *trn_st_);
+        tree_in.close();
+        ofstream dat_out (out_dir + "/" + name + ".dat");
+        dat_out <<  setw(COL_W) << "leaf";
+        dat_out <<  setw(COL_W) << "error rate";
+        dat_out <<  setw(COL_W) << "true nn";
+        dat_out <<  setw(COL_W) << "subdomain";
+        dat_out << endl;
+        thread t [leaf_size_array_len];
+        string r [leaf_size_array_len];
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            t[i] = thread(&Test::s_rotated_kd_tree_data, this, &tree, leaf_size_array[i], &(r[i]));
+        }
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            t[i].join();
+            dat_out << r[i];
+        }
+        dat_out.close();
+    }
+
     void s_n_spill_tree_data(double leaf_size, double a_value, int num_splits, string * result)
     {
 		LOG_INFO("Running n spill tree test of size %ld.\n", (*tst_st_).size());
@@ -418,7 +725,67 @@ public:
         dat_out.close();
     }
     
-    void s_rkd_tree_data(double leaf_size, string * result, int n)
+    void s_pn_spill_tree_data(PNSpillTree<Label, T> * tree, double leaf_size, double a_value,
+            string * result)
+    {
+		LOG_INFO("Running projected n spill tree test of size %ld.\n", (*tst_st_).size());
+        size_t error_count = 0;
+        size_t true_nn_count = 0;
+        unsigned long long subdomain_count = 0;
+        size_t projection_count = 0;
+        for (size_t i = 0; i < (*tst_st_).size(); i++) {
+            DataSet<Label, T> subSet = (*trn_st_).subset(tree->subdomain((*tst_st_)[i],
+                        (size_t)(leaf_size * (*trn_st_).size()), &projection_count));
+            vector<T> * nn_vtr = nearest_neighbor((*tst_st_)[i], subSet);
+            Label nn_lbl = (*trn_st_).get_label(nn_vtr);
+            if (nn_lbl != (*tst_st_).get_label(i))
+                error_count++;
+            if (nn_vtr == (*trn_st_)[nn_mp_[(*tst_st_)[i]][0]])
+                true_nn_count++;
+            subdomain_count += subSet.size();
+        }
+        stringstream data;
+        data <<  setw(COL_W) <<  leaf_size;
+        data <<  setw(COL_W) <<  a_value;
+        data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (subdomain_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (projection_count * 1. / (*tst_st_).size());
+        data << endl;
+        *result = data.str();
+		LOG_INFO("Done projected n spill tree test.\n");
+    }
+
+    void generate_pn_spill_tree_data(string out_dir, bool random_dir)
+    {
+        stringstream name;
+        name << out_dir << (random_dir ? "/rp_" : "/pca_") << pn_splits << "_spill_tree.dat";
+        ofstream dat_out (name.str());
+        dat_out <<  setw(COL_W) << "leaf";
+        dat_out <<  setw(COL_W) << "alpha";
+        dat_out <<  setw(COL_W) << "error rate";
+        dat_out <<  setw(COL_W) << "true nn";
+        dat_out <<  setw(COL_W) << "subdomain";
+        dat_out <<  setw(COL_W) << "projections";
+        dat_out << endl;
+        for (size_t j = 0; j < a_array_len; j++) {
+            ifstream tree_in (pn_spill_tree_path(min_leaf, a_array[j], random_dir), ios::binary);
+            PNSpillTree<Label, T> tree (tree_in, *trn_st_);
+            tree_in.close();
+            thread t [leaf_size_array_len];
+            string r [leaf_size_array_len];
+            for (size_t i = 0; i < leaf_size_array_len; i++)
+                t[i] = thread(&Test<Label, T>::s_pn_spill_tree_data, this, &tree,
+                        leaf_size_array[i], a_array[j], &(r[i]));
+            for (size_t i = 0; i < leaf_size_array_len; i++) {
+                t[i].join();
+                dat_out << r[i];
+            }
+        }
+        dat_out.close();
+    }
+
+    void s_rkd_tree_data(Forest<RKDTree<Label, T> > * forest, double leaf_size, string * result, int n)
     {
 		LOG_INFO("Running rkd trees test of size %ld.\n", (*tst_st_).size());
         size_t error_count = 0;
@@ -427,10 +794,7 @@ public:
         vector<vector<size_t>> nn_domain;
         for (int j=1; j<=n; j++) {
 			LOG_INFO("Running queries in rkd tree %d.\n", j);
-            stringstream dir;
-            dir << base_dir_ << "/rkd_tree" << j << "_" << setprecision(2) << min_leaf;
-            ifstream tree_in (dir.str(), ios::binary);
-            RKDTree<Label, T> tree (tree_in, *trn_st_);
+            RKDTree<Label, T> & tree = forest->get_tree(j-1);
             for (size_t i = 0; i < (*tst_st_).size(); i++) {
                 DataSet<Label, T> subSet = (*trn_st_).subset(tree.subdomain((*tst_st_)[i], (size_t)((leaf_size / n) * (*trn_st_).size())));
                 if (nn_domain.size() < i+1){
@@ -441,7 +805,6 @@ public:
                 }
                 subdomain_count += subSet.size();
             }
-            dir.str("");
         }
 		LOG_INFO("Queries linear search in all trees.\n");
         for (size_t i = 0; i < (*tst_st_).size(); i++) {
@@ -473,6 +836,11 @@ public:
     
     void generate_rkd_tree_data(string out_dir)
     {
+        Forest<RKDTree<Label, T> > forest (forest_path("rkd", min_leaf), *trn_st_);
+        if (forest.size() < rkd_tree[rkd_tree_len-1]) {
+            LOG_WARNING("Not enough rkd trees found!!!\n");
+            return;
+        }
         for(int k=0; k<rkd_tree_len; k++) {
             ofstream dat_out (out_dir + "/" + to_string(int(rkd_tree[k])) + "rkd_tree.dat");
             dat_out <<  setw(COL_W) << "leaf";
@@ -483,7 +851,7 @@ public:
             thread t [leaf_size_array_len];
             string r [leaf_size_array_len];
             for (size_t i = 0; i < leaf_size_array_len; i++) {
-                t[i] = thread(&Test::s_rkd_tree_data, this, leaf_size_array[i], &(r[i]), rkd_tree[k]);
+                t[i] = thread(&Test::s_rkd_tree_data, this, &forest, leaf_size_array[i], &(r[i]), rkd_tree[k]);
             }
             for (size_t i = 0; i < leaf_size_array_len; i++) {
                 t[i].join();
@@ -493,7 +861,7 @@ public:
         }
     }
     
-    void s_v2_tree_data(double leaf_size, string * result, int n)
+    void s_v2_tree_data(Forest<V2Tree<Label, T> > * forest, double leaf_size, string * result, int n)
     {
 		LOG_INFO("Running V2 trees test of size %ld.\n", (*tst_st_).size());
         size_t error_count = 0;
@@ -502,10 +870,7 @@ public:
         vector<vector<size_t>> nn_domain;
         for (int j=1; j<=n; j++) {
 			LOG_INFO("Running queries in v2 tree %d.\n", j);
-            stringstream dir;
-            dir << base_dir_ << "/v2_tree" << j << "_" << setprecision(2) << min_leaf;
-            ifstream tree_in (dir.str(), ios::binary);
-            V2Tree<Label, T> tree (tree_in, *trn_st_);
+            V2Tree<Label, T> & tree = forest->get_tree(j-1);
             for (size_t i = 0; i < (*tst_st_).size(); i++) {
                 DataSet<Label, T> subSet = (*trn_st_).subset(tree.subdomain((*tst_st_)[i], (size_t)((leaf_size / n) * (*trn_st_).size())));
                 if (nn_domain.size() < i+1){
@@ -526,7 +891,6 @@ public:
                 }
                 //subdomain_count += depth;
             }
-            dir.str("");
         }
 		LOG_INFO("Queries linear search in all trees.\n");
         for (size_t i = 0; i < (*tst_st_).size(); i++) {
@@ -556,10 +920,21 @@ public:
 		LOG_INFO("Done v2 trees test.\n");
     }
     
-    void generate_v2_tree_data(string out_dir)
+    void generate_v2_tree_data(string out_dir, SplitRule rule = SPLIT_MEDIAN)
+    {
+        v2_bundle_data(out_dir, v2_name(rule));
+    }
+
+    /* Evaluates the v2 bundle saved under name, writing <n><name>_tree.dat */
+    void v2_bundle_data(string out_dir, const string & name)
     {
+        Forest<V2Tree<Label, T> > forest (forest_path(name, min_leaf), *trn_st_);
+        if (forest.size() < v2_tree[v2_tree_len-1]) {
+            LOG_WARNING("Not enough v2 trees found!!!\n");
+            return;
+        }
         for(int k=0; k<v2_tree_len; k++) {
-            ofstream dat_out (out_dir + "/" + to_string(int(v2_tree[k])) + "v2_tree.dat");
+            ofstream dat_out (out_dir + "/" + to_string(int(v2_tree[k])) + name + "_tree.dat");
             dat_out <<  setw(COL_W) << "leaf";
             dat_out <<  setw(COL_W) << "error rate";
             dat_out <<  setw(COL_W) << "true nn";
@@ -568,7 +943,7 @@ public:
             thread t [leaf_size_array_len];
             string r [leaf_size_array_len];
             for (size_t i = 0; i < leaf_size_array_len; i++) {
-                t[i] = thread(&Test::s_v2_tree_data, this, leaf_size_array[i], &(r[i]), v2_tree[k]);
+                t[i] = thread(&Test::s_v2_tree_data, this, &forest, leaf_size_array[i], &(r[i]), v2_tree[k]);
             }
             for (size_t i = 0; i < leaf_size_array_len; i++) {
                 t[i].join();
@@ -578,13 +953,17 @@ public:
         }
     }
 
-    void s_kd_spill_tree_data(double leaf_size, double a_value, string * result)
+    void s_kd_spill_tree_data(double leaf_size, double a_value, bool budgeted, string * result)
     {
 		LOG_INFO("Running kd spill trees test of size %ld.\n", (*tst_st_).size());
         stringstream dir; 
-        dir << base_dir_ << "/kd_spill_tree_" << setprecision(2) << a_value << "_" << min_leaf;
-        ifstream tree_in (dir.str(), ios::binary);
-        KDSpillTree<Label, T> tree (tree_in, *trn_st_);
+        dir << base_dir_ << (budgeted ? "/kd_spill_budget_tree_" : "/kd_spill_tree_")
+            << setprecision(2) << a_value << "_" << min_leaf;
+        FlatTree<Label, T> tree (dir.str() + ".flat", *trn_st_);
+        if (!tree.good()) {
+            LOG_ERROR("No flat tree at %s.flat, run flatten first\n", dir.str().c_str());
+            return;
+        }
         size_t error_count = 0;
         size_t true_nn_count = 0;
         unsigned long long subdomain_count = 0;
@@ -610,42 +989,21 @@ public:
         }
         
         //calculate space blowup
-        size_t space_blowup = 0;
-        int number_leaves = 1;
-        LOG_INFO("Calculating space blowup.\n");
-        size_t l_c = (size_t)(leaf_size * (*trn_st_).size());
-        queue<KDTreeNode<Label, T> *> expl;
-        expl.push(tree.get_root());
-        while (!expl.empty())
-        {
-            KDTreeNode<Label, T> * cur = expl.front();
-            expl.pop();
-            if (cur->get_left() && cur->get_right() && cur->get_domain().size() >= l_c) {
-                expl.push(cur->get_right());
-                number_leaves = number_leaves * 2;
-			}
-			else {
-				size_t dsize = cur->get_domain().size();
-				space_blowup = dsize * number_leaves;
-				break;
-			}
-        }
-        LOG_INFO("Done calculation\n");
-        size_t root_size = tree.get_root()->get_domain().size();
-        
+        double space_blowup = tree.space_blowup((size_t)(leaf_size * (*trn_st_).size()));
+
         stringstream data;
         data <<  setw(COL_W) << leaf_size;
         data <<  setw(COL_W) << a_value;
         data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
         data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
         data <<  setw(COL_W) << (subdomain_count * 1. / (*tst_st_).size());
-        data <<  setw(COL_W) << 1. * space_blowup/root_size;
+        data <<  setw(COL_W) << space_blowup;
         data << endl;
         *result = data.str();
 		LOG_INFO("Done kd spill tree test.\n");
     }
 
-    void generate_kd_spill_tree_data(string out_dir)
+    void generate_kd_spill_tree_data(string out_dir, bool budgeted = false)
     {
 		//thread t[leaf_size_array_len][a_array_len];
 		string r[a_array_len][leaf_size_array_len];
@@ -653,19 +1011,20 @@ public:
 		//Multi threading
 		/*for (size_t j = 0; j < a_array_len; j++) {
 			for (size_t i = 0; i < leaf_size_array_len; i++) {
-				t[i][j] = thread(&Test<Label, T>::s_kd_spill_tree_data, this, leaf_size_array[i], a_array[j], &(r[i][j]));
+				t[i][j] = thread(&Test<Label, T>::s_kd_spill_tree_data, this, leaf_size_array[i], a_array[j], budgeted, &(r[i][j]));
 			}
 		}*/
 
 		//single thread process for large dataset
 		for (size_t i = 0; i < a_array_len; i++) {
 			for (size_t j = 0; j < leaf_size_array_len; j++) {
-				s_kd_spill_tree_data(leaf_size_array[j], a_array[i], &(r[i][j]));
+				s_kd_spill_tree_data(leaf_size_array[j], a_array[i], budgeted, &(r[i][j]));
 			}
 		}
 		for (size_t i = 0; i < a_array_len; i++) {
 			stringstream dir;
-			dir << out_dir << "/kd_spill_tree_" << setprecision(2) << a_array[i] << ".dat";
+			dir << out_dir << (budgeted ? "/kd_spill_budget_tree_" : "/kd_spill_tree_")
+                << setprecision(2) << a_array[i] << ".dat";
 			ofstream dat_out(dir.str());
 			dat_out << setw(COL_W) << "leaf";
 			dat_out << setw(COL_W) << "alpha";
@@ -682,19 +1041,27 @@ public:
 		}
     }
 
-    void s_kd_v_spill_tree_data(double leaf_size, double a_value, string * result)
+    void s_kd_v_spill_tree_data(double leaf_size, double a_value, string * result, bool from_ranges)
     {
 		LOG_INFO("Running kd virtual spill trees test of size %ld.\n", (*tst_st_).size());
         stringstream dir; 
-        dir << base_dir_ << "/kd_v_spill_tree_" << setprecision(2) << a_value << "_" << min_leaf;
+        if (from_ranges)
+            dir << base_dir_ << "/kd_tree_" << setprecision(2) << min_leaf;
+        else
+            dir << base_dir_ << "/kd_v_spill_tree_" << setprecision(2) << a_value << "_" << min_leaf;
         ifstream tree_in (dir.str(), ios::binary);
-        KDVirtualSpillTree<Label, T> tree (tree_in, *trn_st_);
+        ifstream range_in;
+        if (from_ranges)
+            range_in.open(kd_v_spill_range_path(min_leaf, a_value), ios::binary);
+        KDVirtualSpillTree<Label, T> * tree = from_ranges ?
+            new KDVirtualSpillTree<Label, T>(tree_in, range_in, *trn_st_) :
+            new KDVirtualSpillTree<Label, T>(tree_in, *trn_st_);
         size_t error_count = 0;
         size_t true_nn_count = 0;
         unsigned long long subdomain_count = 0;
         size_t number_of_leaves = 0;
         for (size_t i = 0; i < (*tst_st_).size(); i++) {
-            DataSet<Label, T> subSet = (*trn_st_).subset(tree.subdomain((*tst_st_)[i], (size_t)(leaf_size * (*trn_st_).size()), & number_of_leaves));
+            DataSet<Label, T> subSet = (*trn_st_).subset(tree->subdomain((*tst_st_)[i], (size_t)(leaf_size * (*trn_st_).size()), & number_of_leaves));
             vector<T> * nn_vtr = nearest_neighbor((*tst_st_)[i], subSet);
             Label nn_lbl = (*trn_st_).get_label(nn_vtr);
             if (nn_lbl != (*tst_st_).get_label(i))
@@ -712,10 +1079,11 @@ public:
         data <<  setw(COL_W) << (number_of_leaves * 1. / (*tst_st_).size());
         data << endl;
         *result = data.str();
+        delete tree;
 		LOG_INFO("Done kd virtual spill tree test.\n");
     }
 
-    void generate_kd_v_spill_tree_data(string out_dir)
+    void generate_kd_v_spill_tree_data(string out_dir, bool from_ranges = false)
     {
         ofstream dat_out (out_dir + "/kd_v_spill_tree.dat");
         dat_out <<  setw(COL_W) << "leaf";
@@ -729,7 +1097,7 @@ public:
         string r [leaf_size_array_len][a_array_len];
         for (size_t i = 0; i < leaf_size_array_len; i++) {
             for (size_t j = 0; j < a_array_len; j++) {
-                t[i][j] = thread(&Test<Label, T>::s_kd_v_spill_tree_data, this, leaf_size_array[i], a_array[j], &(r[i][j]));
+                t[i][j] = thread(&Test<Label, T>::s_kd_v_spill_tree_data, this, leaf_size_array[i], a_array[j], &(r[i][j]), from_ranges);
             }
         }
         for (size_t i = 0; i < leaf_size_array_len; i++) {
@@ -741,7 +1109,71 @@ public:
         dat_out.close();
     }
 
-    void s_rp_tree_data(double leaf_size, string * result, int n)
+    void s_kd_v_sketch_tree_data(KDVirtualSpillTree<Label, T> * tree, double leaf_size, double a_value, string * result)
+    {
+		LOG_INFO("Running kd virtual spill sketch test of size %ld.\n", (*tst_st_).size());
+        size_t error_count = 0;
+        size_t true_nn_count = 0;
+        unsigned long long subdomain_count = 0;
+        size_t number_of_leaves = 0;
+        for (size_t i = 0; i < (*tst_st_).size(); i++) {
+            DataSet<Label, T> subSet = (*trn_st_).subset(tree->subdomain((*tst_st_)[i], (size_t)(leaf_size * (*trn_st_).size()), & number_of_leaves, a_value));
+            vector<T> * nn_vtr = nearest_neighbor((*tst_st_)[i], subSet);
+            Label nn_lbl = (*trn_st_).get_label(nn_vtr);
+            if (nn_lbl != (*tst_st_).get_label(i))
+                error_count++;
+            if (nn_vtr == (*trn_st_)[nn_mp_[(*tst_st_)[i]][0]])
+                true_nn_count++;
+            subdomain_count += subSet.size();
+        }
+        stringstream data;
+        data <<  setw(COL_W) << leaf_size;
+        data <<  setw(COL_W) << a_value;
+        data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (subdomain_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (number_of_leaves * 1. / (*tst_st_).size());
+        data << endl;
+        *result = data.str();
+		LOG_INFO("Done kd virtual spill sketch test.\n");
+    }
+
+    /*
+     * Loads the saved kd tree once, sketches its nodes and sweeps every
+     * a_array factor at query time without rebuilding the tree.
+     */
+    void generate_kd_v_sketch_tree_data(string out_dir)
+    {
+        stringstream dir;
+        dir << base_dir_ << "/kd_tree_" << setprecision(2) << min_leaf;
+        ifstream tree_in (dir.str(), ios::binary);
+        KDVirtualSpillTree<Label, T> tree (tree_in, a_array[0], *trn_st_, true);
+        tree_in.close();
+        ofstream dat_out (out_dir + "/kd_v_sketch_tree.dat");
+        dat_out <<  setw(COL_W) << "leaf";
+        dat_out <<  setw(COL_W) << "alpha";
+        dat_out <<  setw(COL_W) << "error rate";
+        dat_out <<  setw(COL_W) << "true nn";
+        dat_out <<  setw(COL_W) << "subdomain";
+        dat_out <<  setw(COL_W) << "number of leaves";
+        dat_out << endl;
+        thread t [leaf_size_array_len][a_array_len];
+        string r [leaf_size_array_len][a_array_len];
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            for (size_t j = 0; j < a_array_len; j++) {
+                t[i][j] = thread(&Test<Label, T>::s_kd_v_sketch_tree_data, this, &tree, leaf_size_array[i], a_array[j], &(r[i][j]));
+            }
+        }
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            for (size_t j = 0; j < a_array_len; j++) {
+                t[i][j].join();
+                dat_out << r[i][j];
+            }
+        }
+        dat_out.close();
+    }
+
+    void s_rp_tree_data(Forest<RPTree<Label, T> > * forest, double leaf_size, string * result, int n)
     {
 		LOG_INFO("Running rp trees test of size %ld.\n", (*tst_st_).size());
         size_t error_count = 0;
@@ -750,10 +1182,7 @@ public:
         vector<vector<size_t>> nn_domain;
         for (int j=1; j<=n; j++) {
 			LOG_INFO("Running queries in rp tree %d.\n", j);
-            stringstream dir;
-            dir << base_dir_ << "/rp_tree_" << j << "_" << setprecision(2) << min_leaf;
-            ifstream tree_in (dir.str(), ios::binary);
-            RPTree<Label, T> tree (tree_in, *trn_st_);
+            RPTree<Label, T> & tree = forest->get_tree(j-1);
             for (size_t i = 0; i < (*tst_st_).size(); i++) {
                 DataSet<Label, T> subSet = (*trn_st_).subset(tree.subdomain((*tst_st_)[i], (size_t)((leaf_size / n) * (*trn_st_).size())));
                 if (nn_domain.size() < i+1) {
@@ -774,7 +1203,6 @@ public:
                 }
                 //subdomain_count += depth;
             }
-            dir.str("");
         }
 		LOG_INFO("Queries linear search in all trees.\n");
         for (size_t i = 0; i < (*tst_st_).size(); i++) {
@@ -806,10 +1234,33 @@ public:
 		LOG_INFO("Done rp trees test.\n");
     }
     
-    void generate_rp_tree_data(string out_dir)
+    void generate_rp_tree_data(string out_dir, bool sparse = false, SplitRule rule = SPLIT_MEDIAN)
+    {
+        rp_bundle_data(out_dir, rp_name(sparse, rule));
+    }
+
+    /*
+     * The level-shared forests of the rp_forest and v2_forest modes are
+     * saved apart from the rp and v2 trees, as rp_level and v2_level.
+     */
+    void generate_rp_forest_data(string out_dir, bool v2 = false)
+    {
+        if (v2)
+            v2_bundle_data(out_dir, "v2_level");
+        else
+            rp_bundle_data(out_dir, "rp_level");
+    }
+
+    /* Evaluates the rp bundle saved under name, writing <n><name>_tree.dat */
+    void rp_bundle_data(string out_dir, const string & name)
     {
+        Forest<RPTree<Label, T> > forest (forest_path(name, min_leaf), *trn_st_);
+        if (forest.size() < rp_tree[rp_tree_len-1]) {
+            LOG_WARNING("Not enough rp trees found!!!\n");
+            return;
+        }
         for(int k=0; k<rp_tree_len; k++) {
-            ofstream dat_out (out_dir + "/" + to_string(int(rp_tree[k])) + "rp_tree.dat");
+            ofstream dat_out (out_dir + "/" + to_string(int(rp_tree[k])) + name + "_tree.dat");
             dat_out <<  setw(COL_W) << "leaf";
             dat_out <<  setw(COL_W) << "error rate";
             dat_out <<  setw(COL_W) << "true nn";
@@ -818,7 +1269,7 @@ public:
             thread t [leaf_size_array_len];
             string r [leaf_size_array_len];
             for (size_t i = 0; i < leaf_size_array_len; i++) {
-                t[i] = thread(&Test::s_rp_tree_data, this, leaf_size_array[i], &(r[i]), rp_tree[k]);
+                t[i] = thread(&Test::s_rp_tree_data, this, &forest, leaf_size_array[i], &(r[i]), rp_tree[k]);
             }
             for (size_t i = 0; i < leaf_size_array_len; i++) {
                 t[i].join();
@@ -829,13 +1280,16 @@ public:
     }
 
     
-    void s_pca_tree_data(double leaf_size, string * result)
+    void s_pca_tree_data(double leaf_size, string * result, SplitRule rule)
     {
 		LOG_INFO("Running pca trees test of size %ld.\n", (*tst_st_).size());
         stringstream dir;
-        dir << base_dir_ << "/pca_tree_" << setprecision(2) << min_leaf;
-        ifstream tree_in (dir.str(), ios::binary);
-        PCATree<Label, T> tree (tree_in, *trn_st_);
+        dir << base_dir_ << "/" << pca_name(rule) << "_tree_" << setprecision(2) << min_leaf;
+        FlatTree<Label, T> tree (dir.str() + ".flat", *trn_st_);
+        if (!tree.good()) {
+            LOG_ERROR("No flat tree at %s.flat, run flatten first\n", dir.str().c_str());
+            return;
+        }
         size_t error_count = 0;
         size_t true_nn_count = 0;
         unsigned long long subdomain_count = 0;
@@ -869,9 +1323,9 @@ public:
 		LOG_INFO("Done pca trees test.\n");
     }
     
-    void generate_pca_tree_data(string out_dir)
+    void generate_pca_tree_data(string out_dir, SplitRule rule = SPLIT_MEDIAN)
     {
-        ofstream dat_out (out_dir + "/pca_tree.dat");
+        ofstream dat_out (out_dir + "/" + pca_name(rule) + "_tree.dat");
         dat_out <<  setw(COL_W) << "leaf";
         dat_out <<  setw(COL_W) << "error rate";
         dat_out <<  setw(COL_W) << "true nn";
@@ -880,7 +1334,7 @@ public:
         thread t [leaf_size_array_len];
         string r [leaf_size_array_len];
         for (size_t i = 0; i < leaf_size_array_len; i++) {
-            t[i] = thread(&Test::s_pca_tree_data, this, leaf_size_array[i], &(r[i]));
+            t[i] = thread(&Test::s_pca_tree_data, this, leaf_size_array[i], &(r[i]), rule);
         }
         for (size_t i = 0; i < leaf_size_array_len; i++) {
             t[i].join();
@@ -889,13 +1343,107 @@ public:
         dat_out.close();
     }
 
-    void s_pca_spill_tree_data(double leaf_size, double a_value, string * result)
+    void s_bsp_v_spill_tree_data(const PCATree<Label, T> * tree, double leaf_size, double a_value, string * result)
+    {
+		LOG_INFO("Running bsp virtual spill tree test of size %ld.\n", (*tst_st_).size());
+        size_t error_count = 0;
+        size_t true_nn_count = 0;
+        unsigned long long subdomain_count = 0;
+        size_t number_of_leaves = 0;
+        for (size_t i = 0; i < (*tst_st_).size(); i++) {
+            DataSet<Label, T> subSet = (*trn_st_).subset(tree->spill_subdomain((*tst_st_)[i], (size_t)(leaf_size * (*trn_st_).size()), & number_of_leaves));
+            vector<T> * nn_vtr = nearest_neighbor((*tst_st_)[i], subSet);
+            Label nn_lbl = (*trn_st_).get_label(nn_vtr);
+            if (nn_lbl != (*tst_st_).get_label(i))
+                error_count++;
+			// kNN accuracy
+			for (int k = 0; k < nn_mp_[(*tst_st_)[i]].size(); k++) {
+				if (nn_vtr == (*trn_st_)[nn_mp_[(*tst_st_)[i]][k]]) {
+					true_nn_count++;
+					break;
+				}
+			}
+            subdomain_count += subSet.size();
+        }
+        stringstream data;
+        data <<  setw(COL_W) << leaf_size;
+        data <<  setw(COL_W) << a_value;
+        data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (subdomain_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (number_of_leaves * 1. / (*tst_st_).size());
+        data << endl;
+        *result = data.str();
+		LOG_INFO("Done bsp virtual spill tree test.\n");
+    }
+
+    /*
+     * Queries a saved pca, rp or v2 tree with virtual spilling. The tree is
+     * loaded once and the spill bands of each factor are set from its
+     * projected domains, so no spill tree is built or stored. The rp and v2
+     * runs use the first tree of their forest, as the _0 in their output
+     * name says.
+     */
+    void generate_bsp_v_spill_tree_data(string out_dir, string tree_name)
+    {
+        PCATree<Label, T> * pca = NULL;
+        Forest<PCATree<Label, T> > * forest = NULL;
+        if (tree_name == "pca") {
+            stringstream dir;
+            dir << base_dir_ << "/pca_tree_" << setprecision(2) << min_leaf;
+            ifstream tree_in (dir.str(), ios::binary);
+            if (!tree_in) {
+                LOG_WARNING("No pca tree found!!!\n");
+                return;
+            }
+            pca = new PCATree<Label, T>(tree_in, *trn_st_);
+            tree_in.close();
+        }
+        else {
+            forest = new Forest<PCATree<Label, T> >(forest_path(tree_name, min_leaf), *trn_st_);
+            if (forest->size() == 0) {
+                LOG_WARNING("No %s trees found!!!\n", tree_name.c_str());
+                delete forest;
+                return;
+            }
+        }
+        PCATree<Label, T> & tree = pca ? *pca : forest->get_tree(0);
+        ofstream dat_out (out_dir + "/" + tree_name + (pca ? "_v_spill_tree.dat" : "_v_spill_tree_0.dat"));
+        dat_out <<  setw(COL_W) << "leaf";
+        dat_out <<  setw(COL_W) << "alpha";
+        dat_out <<  setw(COL_W) << "error rate";
+        dat_out <<  setw(COL_W) << "true nn";
+        dat_out <<  setw(COL_W) << "subdomain";
+        dat_out <<  setw(COL_W) << "number of leaves";
+        dat_out << endl;
+        for (size_t j = 0; j < a_array_len; j++) {
+            tree.set_spill_ranges(a_array[j]);
+            thread t [leaf_size_array_len];
+            string r [leaf_size_array_len];
+            for (size_t i = 0; i < leaf_size_array_len; i++) {
+                t[i] = thread(&Test<Label, T>::s_bsp_v_spill_tree_data, this, &tree, leaf_size_array[i], a_array[j], &(r[i]));
+            }
+            for (size_t i = 0; i < leaf_size_array_len; i++) {
+                t[i].join();
+                dat_out << r[i];
+            }
+        }
+        dat_out.close();
+        delete pca;
+        delete forest;
+    }
+
+    void s_pca_spill_tree_data(double leaf_size, double a_value, bool budgeted, string * result)
     {
 		LOG_INFO("Running pca spill tree test of size %ld.\n", (*tst_st_).size());
         stringstream dir; 
-        dir << base_dir_ << "/pca_spill_tree_" << setprecision(2) << a_value << "_" << min_leaf;
-        ifstream tree_in (dir.str(), ios::binary);
-        PCASpillTree<Label, T> tree (tree_in, *trn_st_);
+        dir << base_dir_ << (budgeted ? "/pca_spill_budget_tree_" : "/pca_spill_tree_")
+            << setprecision(2) << a_value << "_" << min_leaf;
+        FlatTree<Label, T> tree (dir.str() + ".flat", *trn_st_);
+        if (!tree.good()) {
+            LOG_ERROR("No flat tree at %s.flat, run flatten first\n", dir.str().c_str());
+            return;
+        }
         size_t error_count = 0;
         size_t true_nn_count = 0;
         unsigned long long subdomain_count = 0;
@@ -921,28 +1469,7 @@ public:
         }
         
         //calculate space blowup
-        size_t space_blowup = 0;
-        int number_leaves = 1;
-        LOG_INFO("Calculate space blowup\n");
-        size_t l_c = (size_t)(leaf_size * (*trn_st_).size());
-        queue<PCATreeNode<Label, T> *> expl;
-        expl.push(tree.get_root());
-        while (!expl.empty())
-        {
-            PCATreeNode<Label, T> * cur = expl.front();
-            expl.pop();
-            if (cur->get_left() && cur->get_right() && cur->get_domain().size() >= l_c) {
-                expl.push(cur->get_right());
-				number_leaves = number_leaves * 2;
-			}
-			else {
-				size_t dsize = cur->get_domain().size();
-				space_blowup = dsize * number_leaves;
-				break;
-			}
-        }
-        LOG_INFO("Done space calculation.\n");
-        size_t root_size = tree.get_root()->get_domain().size();
+        double space_blowup = tree.space_blowup((size_t)(leaf_size * (*trn_st_).size()));
 
         stringstream data;
         data <<  setw(COL_W) << leaf_size;
@@ -950,30 +1477,31 @@ public:
         data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
         data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
         data <<  setw(COL_W) << (subdomain_count * 1. / (*tst_st_).size());
-        data <<  setw(COL_W) << 1. * space_blowup/root_size;
+        data <<  setw(COL_W) << space_blowup;
         data << endl;
         *result = data.str();
 		LOG_INFO("Done pca spill tree test.\n");
     }
 
-    void generate_pca_spill_tree_data(string out_dir)
+    void generate_pca_spill_tree_data(string out_dir, bool budgeted = false)
     {
         //thread t [a_array_len][leaf_size_array_len];
         string r[a_array_len][leaf_size_array_len];
 		/*for (size_t j = 0; j < a_array_len; j++) {
 			for (size_t i = 0; i < leaf_size_array_len; i++) {
-                t[i][j] = thread(&Test<Label, T>::s_pca_spill_tree_data, this, leaf_size_array[i], a_array[j], &(r[i][j]));
+                t[i][j] = thread(&Test<Label, T>::s_pca_spill_tree_data, this, leaf_size_array[i], a_array[j], budgeted, &(r[i][j]));
             }
         }*/
 		for (size_t i = 0; i < a_array_len; i++) {
 			for (size_t j = 0; j < leaf_size_array_len; j++) {
-				s_pca_spill_tree_data(leaf_size_array[j], a_array[i], &(r[i][j]));
+				s_pca_spill_tree_data(leaf_size_array[j], a_array[i], budgeted, &(r[i][j]));
 			}
 		}
 
 		for (size_t i = 0; i < a_array_len; i++) {
 			stringstream dir;
-			dir << out_dir << "/pca_spill_tree_" << setprecision(2) << a_array[i] << ".dat";
+			dir << out_dir << (budgeted ? "/pca_spill_budget_tree_" : "/pca_spill_tree_")
+                << setprecision(2) << a_array[i] << ".dat";
 			ofstream dat_out(dir.str());
 			dat_out << setw(COL_W) << "leaf";
 			dat_out << setw(COL_W) << "alpha";
@@ -990,6 +1518,226 @@ public:
 		}
     }
     
+    /*
+     * Answers the test queries one at a time on a forest, once traversing
+     * the trees and scanning the candidates on the calling thread, and once
+     * spreading both over a worker pool, and reports the median and 99th
+     * percentile latency of each in microseconds.
+     */
+    template<class Tree>
+    void s_forest_latency_data(const Forest<Tree> & forest, double leaf_size, WorkerPool * pool,
+            string * result)
+    {
+		LOG_INFO("Running forest latency test of size %ld.\n", (*tst_st_).size());
+        size_t n = forest.size();
+        size_t l_c = (size_t)((leaf_size / n) * (*trn_st_).size());
+        size_t true_nn_count = 0;
+        size_t candidate_count = 0;
+        vector<double> latency;
+        for (size_t i = 0; i < (*tst_st_).size(); i++) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            vector<T> * nn_vtr = forest.search((*tst_st_)[i], l_c, n, pool, &candidate_count);
+            latency.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+			for (int k = 0; k < nn_mp_[(*tst_st_)[i]].size(); k++) {
+				if (nn_vtr == (*trn_st_)[nn_mp_[(*tst_st_)[i]][k]]) {
+					true_nn_count++;
+					break;
+				}
+			}
+        }
+        sort(latency.begin(), latency.end());
+        stringstream data;
+        data <<  setw(COL_W) << leaf_size;
+        data <<  setw(COL_W) << (pool ? pool->size() : 1);
+        data <<  setw(COL_W) << latency[latency.size() / 2];
+        data <<  setw(COL_W) << latency[min(latency.size() - 1, (size_t)(latency.size() * 0.99))];
+        data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (candidate_count * 1. / (*tst_st_).size());
+        data << endl;
+        *result = data.str();
+		LOG_INFO("Done forest latency test.\n");
+    }
+
+    template<class Tree>
+    void s_forest_latency(string out_dir, string tree_name)
+    {
+        Forest<Tree> forest (forest_path(tree_name, min_leaf), *trn_st_);
+        if (forest.size() == 0) {
+            LOG_WARNING("No %s trees found!!!\n", tree_name.c_str());
+            return;
+        }
+        WorkerPool pool (max(thread::hardware_concurrency(), 1u));
+        ofstream dat_out (out_dir + "/" + tree_name + "_latency.dat");
+        dat_out <<  setw(COL_W) << "leaf";
+        dat_out <<  setw(COL_W) << "threads";
+        dat_out <<  setw(COL_W) << "p50 (us)";
+        dat_out <<  setw(COL_W) << "p99 (us)";
+        dat_out <<  setw(COL_W) << "true nn";
+        dat_out <<  setw(COL_W) << "subdomain";
+        dat_out << endl;
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            string r [2];
+            s_forest_latency_data(forest, leaf_size_array[i], NULL, &(r[0]));
+            s_forest_latency_data(forest, leaf_size_array[i], &pool, &(r[1]));
+            dat_out << r[0] << r[1];
+        }
+        dat_out.close();
+    }
+
+    void generate_forest_latency_data(string out_dir, string tree_name)
+    {
+        if (tree_name == "rkd")
+            s_forest_latency<RKDTree<Label, T> >(out_dir, tree_name);
+        else
+            s_forest_latency<RPTree<Label, T> >(out_dir, tree_name);
+    }
+
+    /*
+     * Queries a forest with a vote budget of vote_fraction times the leaf
+     * size, so only the candidates reached by the most trees are scanned.
+     */
+    template<class Tree>
+    void s_forest_vote_data(const Forest<Tree> * forest, double leaf_size, double vote_fraction,
+            string * result)
+    {
+		LOG_INFO("Running forest vote test of size %ld.\n", (*tst_st_).size());
+        size_t n = forest->size();
+        size_t l_c = (size_t)((leaf_size / n) * (*trn_st_).size());
+        size_t budget = max((size_t)1, (size_t)(vote_fraction * leaf_size * (*trn_st_).size()));
+        size_t error_count = 0;
+        size_t true_nn_count = 0;
+        size_t candidate_count = 0;
+        for (size_t i = 0; i < (*tst_st_).size(); i++) {
+            vector<T> * nn_vtr = forest->search((*tst_st_)[i], l_c, n, NULL, &candidate_count, budget);
+            Label nn_lbl = (*trn_st_).get_label(nn_vtr);
+            if (nn_lbl != (*tst_st_).get_label(i))
+                error_count++;
+			for (int k = 0; k < nn_mp_[(*tst_st_)[i]].size(); k++) {
+				if (nn_vtr == (*trn_st_)[nn_mp_[(*tst_st_)[i]][k]]) {
+					true_nn_count++;
+					break;
+				}
+			}
+        }
+        stringstream data;
+        data <<  setw(COL_W) << leaf_size;
+        data <<  setw(COL_W) << vote_fraction;
+        data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (candidate_count * 1. / (*tst_st_).size());
+        data << endl;
+        *result = data.str();
+		LOG_INFO("Done forest vote test.\n");
+    }
+
+    template<class Tree>
+    void s_forest_vote(string out_dir, string tree_name)
+    {
+        Forest<Tree> forest (forest_path(tree_name, min_leaf), *trn_st_);
+        if (forest.size() == 0) {
+            LOG_WARNING("No %s trees found!!!\n", tree_name.c_str());
+            return;
+        }
+        ofstream dat_out (out_dir + "/" + tree_name + "_vote.dat");
+        dat_out <<  setw(COL_W) << "leaf";
+        dat_out <<  setw(COL_W) << "vote budget";
+        dat_out <<  setw(COL_W) << "error rate";
+        dat_out <<  setw(COL_W) << "true nn";
+        dat_out <<  setw(COL_W) << "subdomain";
+        dat_out << endl;
+        thread t [leaf_size_array_len][vote_array_len];
+        string r [leaf_size_array_len][vote_array_len];
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            for (size_t j = 0; j < vote_array_len; j++) {
+                t[i][j] = thread(&Test<Label, T>::s_forest_vote_data<Tree>, this, &forest, leaf_size_array[i], vote_array[j], &(r[i][j]));
+            }
+        }
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            for (size_t j = 0; j < vote_array_len; j++) {
+                t[i][j].join();
+                dat_out << r[i][j];
+            }
+        }
+        dat_out.close();
+    }
+
+    void generate_forest_vote_data(string out_dir, string tree_name)
+    {
+        if (tree_name == "rkd")
+            s_forest_vote<RKDTree<Label, T> >(out_dir, tree_name);
+        else
+            s_forest_vote<RPTree<Label, T> >(out_dir, tree_name);
+    }
+
+    /*
+     * Queries an RP or V^2 forest with multi-probe search, taking probes
+     * leaves per tree on average, the most ambiguous branches first.
+     */
+    void s_forest_probe_data(const Forest<RPTree<Label, T> > * forest, double leaf_size, double probes,
+            string * result)
+    {
+		LOG_INFO("Running forest probe test of size %ld.\n", (*tst_st_).size());
+        size_t n = forest->size();
+        size_t l_c = (size_t)((leaf_size / n) * (*trn_st_).size());
+        size_t leaf_budget = max((size_t)1, (size_t)(probes * n));
+        size_t error_count = 0;
+        size_t true_nn_count = 0;
+        size_t candidate_count = 0;
+        for (size_t i = 0; i < (*tst_st_).size(); i++) {
+            vector<size_t> domain = forest->probe_candidates((*tst_st_)[i], l_c, n, leaf_budget);
+            candidate_count += domain.size();
+            vector<T> * nn_vtr = forest->scan((*tst_st_)[i], domain);
+            Label nn_lbl = (*trn_st_).get_label(nn_vtr);
+            if (nn_lbl != (*tst_st_).get_label(i))
+                error_count++;
+			for (int k = 0; k < nn_mp_[(*tst_st_)[i]].size(); k++) {
+				if (nn_vtr == (*trn_st_)[nn_mp_[(*tst_st_)[i]][k]]) {
+					true_nn_count++;
+					break;
+				}
+			}
+        }
+        stringstream data;
+        data <<  setw(COL_W) << leaf_size;
+        data <<  setw(COL_W) << probes;
+        data <<  setw(COL_W) << (error_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (true_nn_count * 1. / (*tst_st_).size());
+        data <<  setw(COL_W) << (candidate_count * 1. / (*tst_st_).size());
+        data << endl;
+        *result = data.str();
+		LOG_INFO("Done forest probe test.\n");
+    }
+
+    void generate_forest_probe_data(string out_dir, string tree_name)
+    {
+        Forest<RPTree<Label, T> > forest (forest_path(tree_name, min_leaf), *trn_st_);
+        if (forest.size() == 0) {
+            LOG_WARNING("No %s trees found!!!\n", tree_name.c_str());
+            return;
+        }
+        ofstream dat_out (out_dir + "/" + tree_name + "_probe.dat");
+        dat_out <<  setw(COL_W) << "leaf";
+        dat_out <<  setw(COL_W) << "probes";
+        dat_out <<  setw(COL_W) << "error rate";
+        dat_out <<  setw(COL_W) << "true nn";
+        dat_out <<  setw(COL_W) << "subdomain";
+        dat_out << endl;
+        thread t [leaf_size_array_len][probe_array_len];
+        string r [leaf_size_array_len][probe_array_len];
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            for (size_t j = 0; j < probe_array_len; j++) {
+                t[i][j] = thread(&Test<Label, T>::s_forest_probe_data, this, &forest, leaf_size_array[i], probe_array[j], &(r[i][j]));
+            }
+        }
+        for (size_t i = 0; i < leaf_size_array_len; i++) {
+            for (size_t j = 0; j < probe_array_len; j++) {
+                t[i][j].join();
+                dat_out << r[i][j];
+            }
+        }
+        dat_out.close();
+    }
+
     void difficulty(string out_dir)
     {
         ofstream dat_out (out_dir + "/difficulty.dat");
@@ -1026,7 +1774,8 @@ public:
 
 template<class Label, class T>
 Test<Label, T>::Test(string base_dir) :
-  base_dir_ (base_dir)
+  base_dir_ (base_dir),
+  kd_skeleton_ (NULL)
 {
     LOG_INFO("Loading Data Sets\n");
     ifstream trn_vtr_in (base_dir + "/trn_vtr", ios::binary);
@@ -1087,7 +1836,8 @@ Test<Label, T>::Test(string base_dir) :
 
 template<class Label, class T>
 Test<Label, T>::Test(string base_dir, double c) :
-base_dir_ (base_dir)
+base_dir_ (base_dir),
+kd_skeleton_ (NULL)
 {
     LOG_INFO("Loading Data Sets\n");
     ifstream trn_vtr_in (base_dir + "/trn_vtr", ios::binary);
@@ -1145,6 +1895,7 @@ base_dir_ (base_dir)
 template<class Label, class T>
 Test<Label, T>::~Test()
 {
+    delete kd_skeleton_;
     delete trn_st_;
     delete tst_st_;
 }
@@ -22,6 +22,9 @@ class V2Tree;
  *                    V2Tree(size_t, DataSet<Label, T>)
  *                          - Creates a tree of given min leaf size and
  *                            data set
+ *                    V2Tree(size_t, SplitRule, DataSet<Label, T>)
+ *                          - Creates a tree of given min leaf size whose
+ *                            nodes split by the given rule
  *                    V2Tree(ifstream &, DataSet<Label, T>)
  *                          - De-serialization
  */
@@ -30,18 +33,19 @@ class V2Tree : public RPTree<Label, T>
 {
 private:
     static PCATreeNode<Label, T> * build_tree(size_t c,
-            DataSet<Label, T> & st, vector<size_t> domain);
+            DataSet<Label, T> & st, vector<size_t> domain, SplitRule rule = SPLIT_MEDIAN);
 
     
 public:
     V2Tree(DataSet<Label, T> & st);
     V2Tree(size_t min_leaf_size, DataSet<Label, T> & st);
+    V2Tree(size_t min_leaf_size, SplitRule rule, DataSet<Label, T> & st);
     V2Tree(ifstream & in, DataSet<Label, T> & st);
 };
 
 template<class Label, class T>
 PCATreeNode<Label, T> * V2Tree<Label, T>::build_tree(size_t min_leaf_size,
-        DataSet<Label, T> & st, vector<size_t> domain)
+        DataSet<Label, T> & st, vector<size_t> domain, SplitRule rule)
 {
     LOG_INFO("Enter build_tree\n");
     LOG_FINE("with min_leaf_size = %ld and domain.size = %ld\n", min_leaf_size, domain.size());
@@ -72,9 +76,15 @@ PCATreeNode<Label, T> * V2Tree<Label, T>::build_tree(size_t min_leaf_size,
         values.push_back(product);
     }
     
-    double pivot = selector(values, (size_t)(values.size() * 0.5));
+    double pivot;
+    size_t subdomain_l_lim;
+    if (rule == SPLIT_TWO_MEANS)
+        pivot = two_means_pivot(subst, split_dir, values, subdomain_l_lim);
+    else {
+        pivot = selector(values, (size_t)(values.size() * 0.5));
+        subdomain_l_lim = (size_t)(values.size() * 0.5);
+    }
     vector<size_t> subdomain_l;
-    size_t subdomain_l_lim = (size_t)(values.size() * 0.5);
     LOG_FINE("> l_lim = %ld\n", subdomain_l_lim);
     vector<size_t> subdomain_r; 
     vector<size_t> pivot_pool;
@@ -100,8 +110,8 @@ PCATreeNode<Label, T> * V2Tree<Label, T>::build_tree(size_t min_leaf_size,
         subdomain_r.push_back(curr);
     }
     PCATreeNode<Label, T> * result = new PCATreeNode<Label, T>(split_dir, pivot, domain);
-    result->set_left(build_tree(min_leaf_size, st, subdomain_l));
-    result->set_right(build_tree(min_leaf_size, st, subdomain_r));
+    result->set_left(build_tree(min_leaf_size, st, subdomain_l, rule));
+    result->set_right(build_tree(min_leaf_size, st, subdomain_r, rule));
     LOG_FINE("> sdl = %ld\n", subdomain_l.size());
     LOG_FINE("> sdr = %ld\n", subdomain_r.size());
     LOG_INFO("Exit build_tree\n");
@@ -127,6 +137,15 @@ V2Tree<Label, T>::V2Tree(size_t min_leaf_size, DataSet<Label, T> & st):
     this->set_root(build_tree(min_leaf_size, st, st.get_domain()));
 }
 
+template<class Label, class T>
+V2Tree<Label, T>::V2Tree(size_t min_leaf_size, SplitRule rule, DataSet<Label, T> & st):
+    RPTree<Label, T>(st)
+{
+    LOG_INFO("V2Tree Constructed\n");
+    LOG_FINE("with min_leaf_size = %ld, rule = %d", min_leaf_size, (int)rule);
+    this->set_root(build_tree(min_leaf_size, st, st.get_domain(), rule));
+}
+
 
 template<class Label, class T>
 V2Tree<Label, T>::V2Tree(ifstream & in, DataSet<Label, T> & st) :
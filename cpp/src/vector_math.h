@@ -3,6 +3,14 @@
 
 #include <vector>
 #include <random>
+#include <cmath>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -21,9 +29,50 @@ double distance_to(const vector<T> * v1, const vector<T> * v2)
     return distance;
 }
 
+/*
+ * Calculate distance between two byte vectors with integer arithmetic.
+ * With AVX2, 32 absolute differences are widened to 16 bits and squared
+ * and summed pairwise with vpmaddwd into 32-bit lanes. The lanes are
+ * flushed into 64 bits every 4096 steps so they never overflow.
+ */
+inline double distance_to(const vector<uint8_t> * v1, const vector<uint8_t> * v2)
+{
+    if (v1->size() != v2->size())
+        return -1;
+    size_t n = v1->size();
+    const uint8_t * a = v1->data();
+    const uint8_t * b = v2->data();
+    uint64_t distance = 0;
+    size_t i = 0;
+#ifdef __AVX2__
+    const __m256i zero = _mm256_setzero_si256();
+    while (i + 32 <= n) {
+        __m256i sum = _mm256_setzero_si256();
+        for (size_t step = 0; step < 4096 && i + 32 <= n; step++, i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+            __m256i d = _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x));
+            __m256i lo = _mm256_unpacklo_epi8(d, zero);
+            __m256i hi = _mm256_unpackhi_epi8(d, zero);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(lo, lo));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(hi, hi));
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i *)lanes, sum);
+        for (size_t k = 0; k < 8; k++)
+            distance += lanes[k];
+    }
+#endif
+    for (; i < n; i++) {
+        int d = (int)b[i] - (int)a[i];
+        distance += d * d;
+    }
+    return (double)distance;
+}
+
 /* Calculate dot product of two vectors */
 template<class A, class B>
-double dot(vector<A> v, vector<B> vd)
+double dot(const vector<A> & v, const vector<B> & vd)
 {
     long double factor = 0;
     for (int i = 0; i < v.size() && i < vd.size(); i++)
@@ -31,13 +80,105 @@ double dot(vector<A> v, vector<B> vd)
     return factor;
 }
 
+/* Calculate dot product of a vector and an array of length n */
+template<class A>
+double dot(const vector<A> & v, const double * vd, size_t n)
+{
+    long double factor = 0;
+    for (size_t i = 0; i < v.size() && i < n; i++)
+        factor += v[i] * vd[i];
+    return factor;
+}
+
+/*
+ * Allocator handing out blocks aligned to <Align> bytes, so that a small
+ * array of routing keys starts on a cache line.
+ */
+template<class T, size_t Align = 64>
+struct aligned_allocator
+{
+    typedef T value_type;
+    template<class U> struct rebind { typedef aligned_allocator<U, Align> other; };
+    aligned_allocator() {}
+    template<class U> aligned_allocator(const aligned_allocator<U, Align> &) {}
+    T * allocate(size_t n)
+    {
+        void * p = NULL;
+        if (posix_memalign(&p, Align, max(n, (size_t)1) * sizeof(T)) != 0)
+            throw bad_alloc();
+        return (T *)p;
+    }
+    void deallocate(T * p, size_t)
+    { free(p); }
+};
+
+template<class T, class U, size_t Align>
+bool operator==(const aligned_allocator<T, Align> &, const aligned_allocator<U, Align> &)
+{ return true; }
+
+template<class T, class U, size_t Align>
+bool operator!=(const aligned_allocator<T, Align> &, const aligned_allocator<U, Align> &)
+{ return false; }
+
+/*
+ * Count the keys of the sorted array <keys> of length n that are strictly
+ * less than <value>, i.e. the lower bound of <value>. Short arrays are
+ * counted with a compare-and-add loop the compiler vectorizes, longer ones
+ * are searched by a binary search whose steps are conditional moves.
+ */
+template<class T>
+size_t count_below(const T * keys, size_t n, T value)
+{
+    if (n <= 16) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++)
+            count += keys[i] < value;
+        return count;
+    }
+    const T * base = keys;
+    while (n > 1) {
+        size_t half = n / 2;
+        base = base[half] < value ? base + half : base;
+        n -= half;
+    }
+    return (base - keys) + (*base < value);
+}
+
+#ifdef __AVX2__
+/* With AVX2, 8 float keys are compared at once and the mask is popcounted. */
+template<>
+inline size_t count_below(const float * keys, size_t n, float value)
+{
+    const __m256 v = _mm256_set1_ps(value);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 lt = _mm256_cmp_ps(_mm256_loadu_ps(keys + i), v, _CMP_LT_OQ);
+        count += __builtin_popcount(_mm256_movemask_ps(lt));
+    }
+    for (; i < n; i++)
+        count += keys[i] < value;
+    return count;
+}
+#endif
+
+/*
+ * Random engine of the calling thread, seeded once from random_device, so
+ * trees built on several threads draw independent streams without sharing
+ * the state of rand().
+ */
+inline default_random_engine & thread_generator()
+{
+    static thread_local default_random_engine generator (random_device{}());
+    return generator;
+}
+
 /* Find the k smallest value in vector */
 template<class T>
 T selector(vector<T> st, size_t k)
 {
-	srand(int(time(NULL)));
 	size_t sz = st.size();
-	double randomIndex = rand() % sz;
+	size_t randomIndex = uniform_int_distribution<size_t>(0, sz - 1)(thread_generator());
     
 	vector<T> left;
 	vector<T> right;
@@ -62,6 +203,176 @@ T selector(vector<T> st, size_t k)
 		return selector(right, (size_t)(k - left.size() - v.size()));
 }
 
+/*
+ * Choose the spill factor of a node holding <values> under a space blowup
+ * <budget> for its subtree. A node of <splits> children stores about
+ * (1 + 2 (splits - 1) a) times its points at spill factor a. The budget is
+ * shared evenly over the levels left down to <min_leaf_size>, then scaled by
+ * how much denser the values are around the median than over the middle
+ * half, so dense boundaries spill more. The result never exceeds
+ * <max_spill_factor> nor what the budget itself allows; the children get
+ * the budget left over.
+ */
+template<class V>
+double budget_spill_factor(vector<V> values, double max_spill_factor, double budget,
+        size_t min_leaf_size, size_t splits = 2)
+{
+    double weight = 2. * (splits - 1);
+    if (values.size() < 2 || budget <= 1 || weight <= 0)
+        return 0;
+    double levels = log((double)values.size() / max(min_leaf_size, (size_t)1)) / log((double)splits);
+    levels = max(levels, 1.);
+    double even = (pow(budget, 1. / levels) - 1) / weight;
+    even = min(even, 0.5 / weight);
+    if (even <= 0)
+        return 0;
+    size_t n = values.size();
+    size_t ranks[4] = { (size_t)((n - 1) * 0.25), (size_t)((n - 1) * (0.5 - even)),
+        (size_t)((n - 1) * (0.5 + even)), (size_t)((n - 1) * 0.75) };
+    double q[4];
+    for (size_t i = 0; i < 4; i++) {
+        nth_element(values.begin(), values.begin() + ranks[i], values.end());
+        q[i] = (double)values[ranks[i]];
+    }
+    double band = q[2] - q[1];
+    double middle = q[3] - q[0];
+    double density = 1;
+    if (band <= 0)
+        density = middle > 0 ? HUGE_VAL : 1;
+    else if (middle > 0)
+        density = 4 * even * middle / band;
+    double spill_factor = even * density;
+    spill_factor = min(spill_factor, max_spill_factor);
+    spill_factor = min(spill_factor, (budget - 1) / weight);
+    return spill_factor;
+}
+
+/*
+ * Seeds of tie breakers stay below TIE_SEED_LIMIT, so the top bit of a
+ * seed is free to flag it in the serialized formats.
+ */
+#define TIE_SEED_LIMIT      (((uint64_t)1 << 63) - 1)
+
+/* Draw a random tie breaker seed */
+inline uint64_t random_tie_seed()
+{
+    random_device rd;
+    uint64_t seed = ((uint64_t)rd() << 32) ^ rd();
+    return seed % TIE_SEED_LIMIT;
+}
+
+/* Return the next value of a splitmix64 sequence and advance <state> */
+inline uint64_t splitmix64(uint64_t & state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Write coordinates 2k and 2k+1 of the Gaussian tie breaker of <seed> to
+ * <out>, by Box-Muller over two splitmix64 draws. The pair depends only on
+ * the seed and k, so any coordinate can be regenerated on its own.
+ */
+inline void seeded_gaussian_pair(uint64_t seed, size_t k, double * out)
+{
+    uint64_t state = seed + 2 * k * 0x9e3779b97f4a7c15ULL;
+    double u1 = ((splitmix64(state) >> 11) + 1) * (1. / 9007199254740992.);
+    double u2 = (splitmix64(state) >> 11) * (1. / 9007199254740992.);
+    double r = sqrt(-2 * log(u1));
+    out[0] = r * cos(2 * M_PI * u2);
+    out[1] = r * sin(2 * M_PI * u2);
+}
+
+/* Regenerate the tie breaker vector of <seed> */
+inline vector<double> seeded_tie_breaker(uint64_t seed, size_t dimension)
+{
+    vector<double> tie_breaker(dimension + dimension % 2);
+    for (size_t i = 0; i < dimension; i += 2)
+        seeded_gaussian_pair(seed, i / 2, &tie_breaker[i]);
+    tie_breaker.resize(dimension);
+    return tie_breaker;
+}
+
+/*
+ * Calculate the dot product of a vector with the tie breaker of <seed>
+ * without materializing it. Equals dot(v, seeded_tie_breaker(seed, n)).
+ */
+template<class A>
+double seeded_dot(const vector<A> & v, uint64_t seed, size_t n)
+{
+    long double factor = 0;
+    double pair[2];
+    for (size_t i = 0; i < v.size() && i < n; i++) {
+        if (i % 2 == 0)
+            seeded_gaussian_pair(seed, i / 2, pair);
+        factor += v[i] * pair[i % 2];
+    }
+    return factor;
+}
+
+/*
+ * A sparse direction lists the indices of its nonzero coordinates in
+ * increasing order. The coordinates are +1, or -1 where the index is
+ * flagged with SPARSE_NEGATIVE.
+ */
+#define SPARSE_NEGATIVE     ((uint32_t)1 << 31)
+
+/*
+ * Generate a very sparse random projection direction: each coordinate is
+ * +1 or -1 with probability 1/(2 sqrt(dimension)) each and 0 otherwise,
+ * with at least one nonzero.
+ */
+inline vector<uint32_t> random_sparse_direction(size_t dimension)
+{
+    random_device rd;
+    default_random_engine generator(rd());
+    uniform_real_distribution<double> distribution(0.0, 1.0);
+    double density = 1. / sqrt((double)max(dimension, (size_t)1));
+    vector<uint32_t> dir;
+    while (dir.empty() && dimension > 0) {
+        for (size_t i = 0; i < dimension; i++) {
+            double u = distribution(generator);
+            if (u < density)
+                dir.push_back(u < density / 2 ? i | SPARSE_NEGATIVE : i);
+        }
+    }
+    return dir;
+}
+
+/* Expand a sparse direction into a dense vector of length dimension */
+inline vector<double> dense_direction(const vector<uint32_t> & dir, size_t dimension)
+{
+    vector<double> dense(dimension, 0);
+    for (size_t i = 0; i < dir.size(); i++) {
+        size_t index = dir[i] & ~SPARSE_NEGATIVE;
+        if (index < dimension)
+            dense[index] = dir[i] & SPARSE_NEGATIVE ? -1 : 1;
+    }
+    return dense;
+}
+
+/*
+ * Calculate the dot product of a vector with a sparse direction, touching
+ * only its nonzero coordinates. Equals dot(v, dense_direction(dir, n)).
+ */
+template<class A>
+double sparse_dot(const vector<A> & v, const vector<uint32_t> & dir)
+{
+    long double factor = 0;
+    for (size_t i = 0; i < dir.size(); i++) {
+        size_t index = dir[i] & ~SPARSE_NEGATIVE;
+        if (index >= v.size())
+            break;
+        if (dir[i] & SPARSE_NEGATIVE)
+            factor -= v[index];
+        else
+            factor += v[index];
+    }
+    return factor;
+}
+
 /* Generate a random tie breaker vector */
 vector<double> random_tie_breaker(size_t dimension)
 {
@@ -0,0 +1,154 @@
+/*
+ * File             : worker_pool.h
+ * Summary          : A fixed set of worker threads running the parts of one
+ *                    task together with the calling thread, so that a single
+ *                    query can be spread over several cores without starting
+ *                    threads for it.
+ */
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "logging.h"
+using namespace std;
+
+/* Class Definitions */
+
+/*
+ * Name             : WorkerPool
+ * Description      : Runs task(i) for every part i of a task on its workers
+ *                    and the calling thread, each taking the next part in
+ *                    turn, and returns once every part is done. One task
+ *                    runs at a time.
+ * Data Field(s)    : workers_    - The worker threads
+ *                    run_mutex_  - Serializes the callers of run
+ *                    mutex_      - Guards the round state below
+ *                    start_      - Signals the workers a new round
+ *                    done_       - Signals the caller the end of a round
+ *                    task_       - The task of the current round
+ *                    part_count_ - The number of parts of the current round
+ *                    next_       - The next part to take
+ *                    busy_       - The workers still in the current round
+ *                    round_      - The number of rounds started
+ *                    stop_       - Whether the workers are to exit
+ * Function(s)      : WorkerPool(size_t)
+ *                          - Creates a pool running on the given number of
+ *                            threads, the caller included
+ *                    ~WorkerPool()
+ *                          - Stops and joins the workers
+ *                    size_t size() const
+ *                          - Returns the number of threads, the caller included
+ *                    void run(size_t, const function<void(size_t)> &)
+ *                          - Runs every part of a task
+ */
+class WorkerPool
+{
+private:
+    vector<thread> workers_;
+    mutex run_mutex_;
+    mutex mutex_;
+    condition_variable start_;
+    condition_variable done_;
+    const function<void(size_t)> * task_;
+    size_t part_count_;
+    atomic<size_t> next_;
+    size_t busy_;
+    uint64_t round_;
+    bool stop_;
+    WorkerPool(const WorkerPool &);
+    WorkerPool & operator=(const WorkerPool &);
+    void work();
+    void run_parts();
+public:
+    WorkerPool(size_t thread_count);
+    ~WorkerPool();
+    size_t size() const
+    { return workers_.size() + 1; }
+    void run(size_t part_count, const function<void(size_t)> & task);
+};
+
+/* Private Functions */
+
+/* Takes the parts of the current round until none is left */
+inline void WorkerPool::run_parts()
+{
+    for (size_t i = next_++; i < part_count_; i = next_++)
+        (*task_)(i);
+}
+
+/* Waits for a round, helps with it and reports back, until stopped */
+inline void WorkerPool::work()
+{
+    uint64_t seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock (mutex_);
+            start_.wait(lock, [&]() { return stop_ || round_ != seen; });
+            if (stop_)
+                return;
+            seen = round_;
+        }
+        run_parts();
+        lock_guard<mutex> lock (mutex_);
+        if (--busy_ == 0)
+            done_.notify_one();
+    }
+}
+
+/* Public Functions */
+
+inline WorkerPool::WorkerPool(size_t thread_count) :
+  task_ (NULL),
+  part_count_ (0),
+  next_ (0),
+  busy_ (0),
+  round_ (0),
+  stop_ (false)
+{
+    LOG_INFO("WorkerPool Constructed\n");
+    LOG_FINE("with thread_count = %ld\n", thread_count);
+    for (size_t i = 1; i < thread_count; i++)
+        workers_.push_back(thread(&WorkerPool::work, this));
+}
+
+inline WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock (mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++)
+        workers_[i].join();
+    LOG_INFO("WorkerPool Deconstructed\n");
+}
+
+inline void WorkerPool::run(size_t part_count, const function<void(size_t)> & task)
+{
+    lock_guard<mutex> run_lock (run_mutex_);
+    if (workers_.empty() || part_count < 2) {
+        for (size_t i = 0; i < part_count; i++)
+            task(i);
+        return;
+    }
+    {
+        lock_guard<mutex> lock (mutex_);
+        task_ = &task;
+        part_count_ = part_count;
+        next_ = 0;
+        busy_ = workers_.size();
+        round_++;
+    }
+    start_.notify_all();
+    run_parts();
+    unique_lock<mutex> lock (mutex_);
+    done_.wait(lock, [&]() { return busy_ == 0; });
+}
+
+#endif